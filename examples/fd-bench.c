@@ -0,0 +1,92 @@
+/* fd-bench.c
+
+   Times 1-byte reads from one file while 1, 64, and 1024 file
+   descriptors are open, and prints the average cycles per read:
+
+     pintos ... run 'fd-bench'
+     pintos ... run 'fd-bench 100000'
+
+   The optional argument is the number of reads to time at each
+   table size.  With the file descriptor table kept as an array,
+   the cost of a read should not depend on how many files are
+   open. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+#define FILE_NAME "fd-bench.dat"
+#define MAX_FDS 1024
+
+/* Returns the processor's time-stamp counter. */
+static unsigned long long
+rdtsc (void)
+{
+  unsigned long long tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Makes CNT 1-byte reads from FD and returns the cycles they
+   took. */
+static unsigned long long
+time_reads (int fd, int cnt)
+{
+  unsigned long long start;
+  char byte;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    {
+      seek (fd, 0);
+      read (fd, &byte, 1);
+    }
+  return rdtsc () - start;
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  static const int sizes[] = {1, 64, MAX_FDS};
+  static int fds[MAX_FDS];
+  int cnt = argc > 1 ? atoi (argv[1]) : 10000;
+  int open_cnt = 0;
+  size_t i;
+
+  if (cnt <= 0)
+    {
+      printf ("usage: fd-bench [COUNT]\n");
+      return EXIT_FAILURE;
+    }
+
+  if (!create (FILE_NAME, 1))
+    {
+      printf ("%s: create failed\n", FILE_NAME);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      unsigned long long cycles;
+
+      for (; open_cnt < sizes[i]; open_cnt++)
+        {
+          fds[open_cnt] = open (FILE_NAME);
+          if (fds[open_cnt] < 0)
+            {
+              printf ("%s: open #%d failed\n", FILE_NAME, open_cnt);
+              return EXIT_FAILURE;
+            }
+        }
+
+      /* Read through the most recently opened descriptor. */
+      cycles = time_reads (fds[open_cnt - 1], cnt);
+      printf ("%4d open: %llu cycles per read\n", open_cnt, cycles / cnt);
+    }
+
+  while (open_cnt > 0)
+    close (fds[--open_cnt]);
+  remove (FILE_NAME);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/* mmap-bench.c
+
+   Scans a file once and prints a checksum of its bytes, either
+   through read() into a buffer or through mmap(), so that the
+   two can be compared on large files:
+
+     pintos ... run 'mmap-bench read FILE'
+     pintos ... run 'mmap-bench mmap FILE'
+
+   Compare the timer ticks and disk reads printed at shutdown. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#define BUF_SIZE 4096
+
+static unsigned
+sum_bytes (const unsigned char *p, int size, unsigned sum)
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    sum = sum * 31 + p[i];
+  return sum;
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  static unsigned char buf[BUF_SIZE];
+  void *data = (void *) 0x10000000;
+  unsigned sum = 0;
+  int fd, size;
+
+  if (argc != 3
+      || (strcmp (argv[1], "read") && strcmp (argv[1], "mmap")))
+    {
+      printf ("usage: mmap-bench read|mmap FILE\n");
+      return EXIT_FAILURE;
+    }
+
+  fd = open (argv[2]);
+  if (fd < 0) 
+    {
+      printf ("%s: open failed\n", argv[2]);
+      return EXIT_FAILURE;
+    }
+  size = filesize (fd);
+
+  if (!strcmp (argv[1], "read"))
+    {
+      int n;
+
+      while ((n = read (fd, buf, sizeof buf)) > 0)
+        sum = sum_bytes (buf, n, sum);
+    }
+  else
+    {
+      mapid_t map = mmap (fd, data);
+
+      if (map == MAP_FAILED) 
+        {
+          printf ("%s: mmap failed\n", argv[2]);
+          return EXIT_FAILURE;
+        }
+      sum = sum_bytes (data, size, sum);
+      munmap (map);
+    }
+
+  printf ("%s: %d bytes, checksum %08x\n", argv[2], size, sum);
+  return EXIT_SUCCESS;
+}
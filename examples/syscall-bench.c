@@ -0,0 +1,63 @@
+/* syscall-bench.c
+
+   Times a system call that does no work, tell(), through both
+   ways into the kernel, and prints the average cycles per call:
+
+     pintos ... run 'syscall-bench'
+     pintos ... run 'syscall-bench 100000'
+
+   The optional argument is the number of calls to time on each
+   path. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Returns the processor's time-stamp counter. */
+static unsigned long long
+rdtsc (void)
+{
+  unsigned long long tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Makes CNT calls to tell() and returns the cycles they took. */
+static unsigned long long
+time_calls (int cnt)
+{
+  unsigned long long start = rdtsc ();
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    tell (STDIN_FILENO);
+  return rdtsc () - start;
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  int cnt = argc > 1 ? atoi (argv[1]) : 10000;
+  unsigned long long cycles;
+
+  if (cnt <= 0)
+    {
+      printf ("usage: syscall-bench [COUNT]\n");
+      return EXIT_FAILURE;
+    }
+
+  syscall_sysenter = 0;
+  cycles = time_calls (cnt);
+  printf ("int $0x30: %llu cycles per call\n", cycles / cnt);
+
+  syscall_sysenter = -1;
+  tell (STDIN_FILENO);
+  if (syscall_sysenter)
+    {
+      cycles = time_calls (cnt);
+      printf ("sysenter: %llu cycles per call\n", cycles / cnt);
+    }
+  else
+    printf ("sysenter: not supported by this CPU\n");
+  return EXIT_SUCCESS;
+}
@@ -1,6 +1,6 @@
 #include "filesys/file.h"
+#include <bitmap.h>
 #include <debug.h>
-#include <list.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
@@ -11,8 +11,6 @@ struct file
     struct inode *inode;        /* File inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
-    struct list_elem elem;      /* Project 4 */
-    unsigned int fid;
   };
 
 /* Open a file for the given INODE, of which it takes ownership,
@@ -171,79 +169,135 @@ file_tell (struct file *file)
   return file->pos;
 }
 
-bool less_fid(struct list_elem *, struct list_elem *, void *);
+/* File descriptors.  Each process has an array of open files
+   indexed by fd, and a bitmap of the fds in use, from which new
+   fds are handed out lowest first so that closed ones are reused.
+   Both are allocated on the first open and double in size when
+   they fill up.  Fds 0, 1 and 2 are the console's and are never
+   handed out. */
+#define FD_FIRST 3
+#define FD_INIT_CNT 16
 
-fid_t
-file_insert_in_fd (struct file *file)
+/* Grows the current thread's fd table to at least CNT slots.
+   Returns true if successful, false on allocation failure. */
+static bool
+fd_table_grow (size_t cnt)
 {
-  struct list_elem *e;
-  struct file *f;
   struct thread *t = thread_current ();
-  
-  if(list_empty(&(t->open_file_list)))
-  {
-    file->fid = 3;
-  }
-  else
-  {
-    e = list_max(&(t->open_file_list), less_fid, NULL);
-    f = list_entry(e, struct file, elem);
-    file->fid = f->fid + 1;
-  }
-  list_push_back(&t->open_file_list, &file->elem);
- 
-  return file->fid;
+  struct file **fds;
+  struct bitmap *used;
+  size_t i;
+
+  if (cnt <= t->fd_cnt)
+    return true;
+
+  fds = realloc (t->fds, cnt * sizeof *fds);
+  if (fds == NULL)
+    return false;
+  t->fds = fds;
+  used = bitmap_create (cnt);
+  if (used == NULL)
+    return false;
+
+  for (i = 0; i < cnt; i++)
+    if (i < FD_FIRST || (i < t->fd_cnt && bitmap_test (t->fd_used, i)))
+      bitmap_mark (used, i);
+  for (i = t->fd_cnt; i < cnt; i++)
+    fds[i] = NULL;
+  bitmap_destroy (t->fd_used);
+  t->fd_used = used;
+  t->fd_cnt = cnt;
+  return true;
 }
 
-bool less_fid(struct list_elem *a_, struct list_elem *b_, void *aux UNUSED)
+/* Gives FILE the lowest free fd in the current process and
+   returns it, or -1 if the fd table cannot grow. */
+fid_t
+file_insert_in_fd (struct file *file)
 {
-  const struct file *a = list_entry (a_, struct file, elem);
-  const struct file *b = list_entry (b_, struct file, elem);
-  
-  return a->fid < b->fid;
+  struct thread *t = thread_current ();
+  size_t fd = BITMAP_ERROR;
+
+  if (t->fd_used != NULL)
+    fd = bitmap_scan_and_flip (t->fd_used, 0, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      fd = t->fd_cnt > FD_FIRST ? t->fd_cnt : FD_FIRST;
+      if (!fd_table_grow (t->fd_cnt > 0 ? t->fd_cnt * 2 : FD_INIT_CNT))
+        return -1;
+      bitmap_mark (t->fd_used, fd);
+    }
+  t->fds[fd] = file;
+  return fd;
 }
 
+/* Returns the file open as FD in the current process, or a null
+   pointer if there is none. */
 struct file *
 file_search_in_fd (int fd)
 {
-  struct list_elem *e;
-  struct file *f;
-  struct thread *t = thread_current();
-  int success = 0;
-  
-  for (e = list_begin(&t->open_file_list) ; e != list_end(&t->open_file_list) ; e = list_next(e))
-  {
-    f = list_entry(e, struct file, elem);
-    if (f->fid == fd)
-    {
-      success = 1;
-      break;
-    }
-  }
-  
-  return success ? f : NULL;
+  struct thread *t = thread_current ();
+
+  if (fd < FD_FIRST || (size_t) fd >= t->fd_cnt)
+    return NULL;
+  return t->fds[fd];
 }
-  
+
+/* Frees FD in the current process, without closing its file. */
 void
-file_remove_in_fd(int fd)
+file_remove_in_fd (int fd)
 {
-  struct list_elem *e;
-  struct file *f;
-  struct thread *t = thread_current();
-  
-  for (e = list_begin(&t->open_file_list) ; e != list_end(&t->open_file_list) ; e = list_next(e))
-  {
-    f = list_entry(e, struct file, elem);
-    if (f->fid == fd)
+  struct thread *t = thread_current ();
+
+  if (fd < FD_FIRST || (size_t) fd >= t->fd_cnt || t->fds[fd] == NULL)
+    return;
+  t->fds[fd] = NULL;
+  bitmap_reset (t->fd_used, fd);
+}
+
+/* Opens a copy of each file open in PARENT, for fork(), under
+   the same fd in the current process.  The copies have their own
+   positions, starting where the originals are.  Returns false if
+   a file cannot be reopened or on allocation failure. */
+bool
+file_copy_fd_table (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  size_t fd;
+
+  if (!fd_table_grow (parent->fd_cnt))
+    return false;
+  for (fd = FD_FIRST; fd < parent->fd_cnt; fd++)
     {
-      list_remove(e);
-      break;
+      struct file *f = parent->fds[fd];
+      struct file *copy;
+
+      if (f == NULL)
+        continue;
+      copy = file_reopen (f);
+      if (copy == NULL)
+        return false;
+      copy->pos = f->pos;
+      t->fds[fd] = copy;
+      bitmap_mark (t->fd_used, fd);
     }
-  }
+  return true;
 }
 
+/* Closes every file open in the current process and frees its fd
+   table. */
 void
-file_close_with_list_elem(struct list_elem *e)
+file_close_fd_table (void)
 {
-  file_close(list_entry(e, struct file, elem));
-}  
+  struct thread *t = thread_current ();
+  size_t fd;
+
+  for (fd = FD_FIRST; fd < t->fd_cnt; fd++)
+    if (t->fds[fd] != NULL)
+      file_close (t->fds[fd]);
+  free (t->fds);
+  bitmap_destroy (t->fd_used);
+  t->fds = NULL;
+  t->fd_used = NULL;
+  t->fd_cnt = 0;
+}
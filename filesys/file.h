@@ -2,12 +2,13 @@
 #define FILESYS_FILE_H
 
 #include "filesys/off_t.h"
-#include <list.h>
+#include <stdbool.h>
 
 /* Project 4 */
 typedef int32_t fid_t;
 
 struct inode;
+struct thread;
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
@@ -34,6 +35,7 @@ off_t file_length (struct file *);
 fid_t file_insert_in_fd (struct file *file);
 struct file *file_search_in_fd (int fd);
 void file_remove_in_fd (int fd);
-void file_close_with_list_elem (struct list_elem *);
+bool file_copy_fd_table (struct thread *parent);
+void file_close_fd_table (void);
 
 #endif /* filesys/file.h  */
@@ -0,0 +1,32 @@
+#ifndef __LIB_FAULT_STATS_H
+#define __LIB_FAULT_STATS_H
+
+#include <stdint.h>
+
+/* Page fault classes. */
+enum fault_type
+  {
+    FAULT_ZERO,                 /* Zero-filled a page. */
+    FAULT_SWAP,                 /* Read a page back from swap. */
+    FAULT_FILE,                 /* Read a page from its file. */
+    FAULT_STACK,                /* Grew the stack. */
+    FAULT_COW,                  /* Write to a shared or read-only page. */
+    FAULT_KILL,                 /* Bad access, process killed. */
+    FAULT_TYPE_CNT              /* Number of fault classes. */
+  };
+
+/* Buckets in a fault latency histogram.  Bucket I counts faults
+   that took between 2**I and 2**(I+1) - 1 cycles to service; the
+   last bucket also takes everything slower. */
+#define FAULT_HIST_CNT 32
+
+/* Page fault statistics, for one process or for the system. */
+struct fault_stats
+  {
+    uint32_t count[FAULT_TYPE_CNT];     /* Faults of each class. */
+    uint64_t cycles[FAULT_TYPE_CNT];    /* Total cycles of each class. */
+    uint32_t hist[FAULT_TYPE_CNT][FAULT_HIST_CNT]; /* Latencies. */
+    uint32_t evictions;                 /* Evictions done by faults. */
+  };
+
+#endif /* lib/fault-stats.h */
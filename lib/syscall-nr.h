@@ -29,6 +29,11 @@ enum
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
     SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Duplicate this process. */
+    SYS_MADVISE,                /* Give advice about memory use. */
+    SYS_FAULTSTAT,              /* Get page fault statistics. */
     SYS_LAST                    /* Number of System call */
   };
 
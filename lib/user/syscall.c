@@ -1,16 +1,48 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
 
+/* Whether system calls go through SYSENTER instead of `int
+   $0x30': 1 if so, 0 if not, -1 if not yet known.  The kernel
+   enables SYSENTER whenever CPUID reports it, so that is what we
+   check.  A program may set this to 0 to force `int $0x30'. */
+int syscall_sysenter = -1;
+
+/* Returns true if system calls should use SYSENTER. */
+static inline int
+use_sysenter (void)
+{
+  if (syscall_sysenter < 0)
+    {
+      unsigned eax = 1, ebx, ecx, edx;
+
+      asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+      syscall_sysenter = (edx & 0x800) != 0;
+    }
+  return syscall_sysenter;
+}
+
+/* Traps into the kernel for a system call whose number and
+   arguments have been pushed on the stack, then pops CNT bytes
+   of them.  SYSENTER takes the stack pointer to restore in %ecx
+   and the address to return to in %edx, and does not preserve
+   either. */
+#define SYSCALL_TRAP(CNT)                                       \
+        "testl %[sysenter], %[sysenter]; jz 1f; "               \
+        "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "        \
+        "1: int $0x30; "                                        \
+        "2: addl $" #CNT ", %%esp"
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_TRAP (4)               \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [number] "i" (NUMBER),                         \
+                 [sysenter] "r" (use_sysenter ())               \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -20,11 +52,12 @@
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+            ("pushl %[arg0]; pushl %[number]; " SYSCALL_TRAP (8)         \
                : "=a" (retval)                                           \
                : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+                 [arg0] "g" (ARG0),                                      \
+                 [sysenter] "r" (use_sysenter ())                        \
+               : "ecx", "edx", "memory");                                \
           retval;                                                        \
         })
 
@@ -35,12 +68,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP (12)              \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "g" (ARG0),                             \
-                 [arg1] "g" (ARG1)                              \
-               : "memory");                                     \
+                 [arg1] "g" (ARG1),                             \
+                 [sysenter] "r" (use_sysenter ())               \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -51,13 +85,14 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP (16)              \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "g" (ARG0),                             \
                  [arg1] "g" (ARG1),                             \
-                 [arg2] "g" (ARG2)                              \
-               : "memory");                                     \
+                 [arg2] "g" (ARG2),                             \
+                 [sysenter] "r" (use_sysenter ())               \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -81,6 +116,12 @@ exec (const char *file)
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 int
 wait (pid_t pid)
 {
@@ -153,6 +194,18 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+int
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+bool
+faultstat (struct fault_stats *stats, bool global)
+{
+  return syscall2 (SYS_FAULTSTAT, stats, global);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <fault-stats.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,6 +13,19 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Whether system calls use SYSENTER: 1 if so, 0 to force `int
+   $0x30', -1 to decide on the first call. */
+extern int syscall_sysenter;
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Expect random access: no readahead. */
+#define MADV_SEQUENTIAL 2       /* Expect sequential access. */
+#define MADV_WILLNEED 3         /* Will be needed soon: read in now. */
+#define MADV_DONTNEED 4         /* Not needed: discard contents. */
+#define MADV_LOCK 5             /* Keep in memory. */
+#define MADV_UNLOCK 6           /* Undo MADV_LOCK. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -23,6 +37,7 @@ typedef int mapid_t;
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t exec (const char *file);
+pid_t fork (void);
 int wait (pid_t);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
@@ -37,6 +52,8 @@ void close (int fd);
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+int madvise (void *addr, unsigned length, int advice);
+bool faultstat (struct fault_stats *, bool global);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -0,0 +1,30 @@
+/* Opens the same file many times, closes one of the file
+   descriptors, and checks that the next open reuses it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 100
+
+void
+test_main (void) 
+{
+  int fds[FILE_CNT];
+  int i, j;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      fds[i] = open ("sample.txt");
+      if (fds[i] < 2)
+        fail ("open #%d returned %d", i, fds[i]);
+      for (j = 0; j < i; j++)
+        if (fds[j] == fds[i])
+          fail ("opens #%d and #%d both returned %d", j, i, fds[i]);
+    }
+  msg ("open \"sample.txt\" %d times", FILE_CNT);
+
+  close (fds[FILE_CNT / 2]);
+  CHECK (open ("sample.txt") == fds[FILE_CNT / 2],
+         "open after close reuses the closed fd");
+}
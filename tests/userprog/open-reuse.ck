@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-reuse) begin
+(open-reuse) open "sample.txt" 100 times
+(open-reuse) open after close reuses the closed fd
+(open-reuse) end
+open-reuse: exit(0)
+EOF
+pass;
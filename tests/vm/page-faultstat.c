@@ -0,0 +1,35 @@
+/* Touches a fresh array and checks that the page faults it takes
+   show up in the process's and the system's fault statistics. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 16
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct fault_stats before, after, global;
+  size_t i;
+
+  CHECK (faultstat (&before, false), "faultstat");
+  for (i = 0; i < sizeof buf; i += 4096)
+    buf[i] = 1;
+  CHECK (faultstat (&after, false), "faultstat again");
+  CHECK (faultstat (&global, true), "faultstat global");
+
+  if (after.count[FAULT_ZERO] - before.count[FAULT_ZERO] < PAGES)
+    fail ("%u zero faults for %d fresh pages",
+          after.count[FAULT_ZERO] - before.count[FAULT_ZERO], PAGES);
+  if (after.count[FAULT_KILL] != 0)
+    fail ("%u faults counted as kills", after.count[FAULT_KILL]);
+  for (i = 0; i < FAULT_TYPE_CNT; i++)
+    if (global.count[i] < after.count[i])
+      fail ("global count %zu below process count", i);
+  CHECK (!faultstat ((struct fault_stats *) 0xc0000000, false),
+         "faultstat on kernel address must fail");
+}
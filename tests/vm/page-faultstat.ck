@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-faultstat) begin
+(page-faultstat) faultstat
+(page-faultstat) faultstat again
+(page-faultstat) faultstat global
+(page-faultstat) faultstat on kernel address must fail
+(page-faultstat) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Forks a child that checks and then overwrites its copy of a
+   large array, and verifies that the parent's copy is unchanged
+   afterward. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t pid;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != (char) (i % 251))
+          fail ("child: byte %zu is %d", i, buf[i]);
+      memset (buf, 0x5a, SIZE);
+      msg ("child overwrote its copy");
+      exit (0);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork");
+
+  wait (pid);
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("parent: byte %zu is %d", i, buf[i]);
+  msg ("parent's copy unchanged");
+}
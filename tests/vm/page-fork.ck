@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) child overwrote its copy
+(page-fork) parent's copy unchanged
+(page-fork) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Gives each kind of advice on a large array and checks that the
+   contents survive all but MADV_DONTNEED, which zeros them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+/* Checks that BUF holds its original pattern, or only zeros if
+   ZEROED is true. */
+static void
+check (bool zeroed)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (zeroed ? 0 : (char) (i % 251)))
+      fail ("byte %zu is %d", i, buf[i]);
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  CHECK (madvise (buf, SIZE, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (buf, SIZE, MADV_RANDOM) == 0, "madvise random");
+  CHECK (madvise (buf, SIZE, MADV_WILLNEED) == 0, "madvise willneed");
+  check (false);
+  CHECK (madvise (buf, SIZE, MADV_LOCK) == 0, "madvise lock");
+  check (false);
+  CHECK (madvise (buf, SIZE, MADV_UNLOCK) == 0, "madvise unlock");
+  CHECK (madvise (buf, SIZE, MADV_DONTNEED) == 0, "madvise dontneed");
+  check (true);
+  CHECK (madvise ((void *) 0x10000000, 4096, MADV_WILLNEED) == -1,
+         "madvise unmapped range must fail");
+}
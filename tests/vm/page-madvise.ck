@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-madvise) begin
+(page-madvise) madvise sequential
+(page-madvise) madvise random
+(page-madvise) madvise willneed
+(page-madvise) madvise lock
+(page-madvise) madvise unlock
+(page-madvise) madvise dontneed
+(page-madvise) madvise unmapped range must fail
+(page-madvise) end
+EOF
+pass;
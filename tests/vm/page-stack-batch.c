@@ -0,0 +1,37 @@
+/* Recurses 128 pages deep into the stack and checks that growth
+   read pages in ahead of the faults, so that it took far fewer
+   stack faults than pages. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 128
+
+/* Uses about a page of stack per level, DEPTH levels deep.
+   Returns the sum of the first byte at every level. */
+static int
+recurse (int depth)
+{
+  volatile char frame[4000];
+
+  memset ((char *) frame, depth, sizeof frame);
+  return frame[0] + (depth > 1 ? recurse (depth - 1) : 0);
+}
+
+void
+test_main (void)
+{
+  struct fault_stats before, after;
+  unsigned faults;
+
+  CHECK (faultstat (&before, false), "faultstat");
+  CHECK (recurse (PAGES) == PAGES * (PAGES + 1) / 2,
+         "recurse %d pages deep", PAGES);
+  CHECK (faultstat (&after, false), "faultstat again");
+
+  faults = after.count[FAULT_STACK] - before.count[FAULT_STACK];
+  if (faults >= PAGES / 4)
+    fail ("%u stack faults for %d pages of stack", faults, PAGES);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-stack-batch) begin
+(page-stack-batch) faultstat
+(page-stack-batch) recurse 128 pages deep
+(page-stack-batch) faultstat again
+(page-stack-batch) end
+EOF
+pass;
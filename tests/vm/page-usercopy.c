@@ -0,0 +1,28 @@
+/* Passes system call arguments that sit in pages the process has
+   not touched yet, or that straddle a page boundary, and checks
+   that the kernel brings the pages in rather than reject them. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4 * 4096];
+
+void
+test_main (void)
+{
+  char *page = (char *) (((uintptr_t) buf + 4095) & ~(uintptr_t) 4095);
+  char *name = page + 4096 - 3;
+  struct fault_stats *stats = (struct fault_stats *) (page + 2 * 4096);
+
+  strlcpy (name, "straddle", 16);
+  CHECK (create (name, 0), "create \"%s\" across a page boundary", name);
+  CHECK (remove (name), "remove \"%s\"", name);
+  CHECK (!create ("a-name-far-too-long-for-a-file", 0),
+         "create with too long a name must fail");
+  CHECK (faultstat (stats, false), "faultstat into an untouched page");
+  if (stats->count[FAULT_ZERO] == 0)
+    fail ("no zero-fill faults counted");
+}
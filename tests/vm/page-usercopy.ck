@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-usercopy) begin
+(page-usercopy) create "straddle" across a page boundary
+(page-usercopy) remove "straddle"
+(page-usercopy) create with too long a name must fail
+(page-usercopy) faultstat into an untouched page
+(page-usercopy) end
+EOF
+pass;
@@ -14,6 +14,7 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -25,6 +26,7 @@
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -38,6 +40,12 @@
 
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/page.h"
+#include "vm/pageout.h"
+#include "vm/swap.h"
+#include "vm/trace.h"
+#include "vm/vm.h"
 #endif
 
 /* Amount of physical memory, in 4 kB pages. */
@@ -94,10 +102,14 @@ main (void)
   /* Initialize memory system. */
   palloc_init ();
   malloc_init ();
+#ifdef USERPROG
+  pagedir_init ();
+#endif
   paging_init ();
 
 #ifdef VM
   frame_init ();
+  page_init ();
 #endif
 
   /* Segmentation. */
@@ -127,6 +139,11 @@ main (void)
   filesys_init (format_filesys);
 #endif
   swap_swap_disk_init();
+#ifdef VM
+  pageout_init ();
+  ksm_init ();
+  trace_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -164,6 +181,17 @@ ram_init (void)
    new page directory.  Points base_page_dir to the page
    directory it creates.
 
+   If the CPU supports them, each whole 4 MB of RAM is mapped
+   with a single 4 MB page, which saves a page table per 4 MB in
+   every page directory and a TLB entry per 4 kB page touched by
+   the kernel.  The 4 MB holding the kernel text keeps 4 kB pages,
+   so that the text can stay read-only, and so does a partial
+   4 MB at the end of RAM.
+
+   Kernel mappings are the same in every page directory, so they
+   are marked global if the CPU supports it, and stay in the TLB
+   when CR3 is reloaded on a process switch.
+
    At the time this function is called, the active page table
    (set up by loader.S) only maps the first 4 MB of RAM, so we
    should not try to use extravagant amounts of memory.
@@ -174,6 +202,10 @@ paging_init (void)
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool pse = (features & CPUID_PSE) != 0;
+  uint32_t global = (features & CPUID_PGE) != 0 ? PTE_G : 0;
+  uint32_t cr4;
 
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -185,23 +217,50 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0 && page + PTSPAN / PGSIZE <= ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 BASE ADDRESS
-     OF THE PAGE DIRECTORY. */
+     OF THE PAGE DIRECTORY.  4 MB pages and global pages must be
+     enabled in CR4 first.  See [IA32-v3a] 3.7.3 MIXING 4-KBYTE
+     AND 4-MBYTE PAGES and 3.11 TRANSLATION LOOKASIDE BUFFERS. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (pse)
+    cr4 |= CR4_PSE;
+  if (global)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
 }
 
+/* Returns the CPU's feature flags, CPUID_*.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -265,6 +324,22 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-ksm"))
+        ksm_rate = atoi (value);
+      else if (!strcmp (name, "-vmpolicy"))
+        {
+          if (value == NULL || !vm_set_policy (value))
+            PANIC ("unknown page replacement policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-vmtrace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-rsslimit"))
+        page_rss_limit = atoi (value);
+      else if (!strcmp (name, "-stacklimit"))
+        page_stack_limit = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -387,6 +462,15 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -ksm=RATE          Merge identical user pages, scanning RATE\n"
+          "                     frames every 100 ms.\n"
+          "  -vmpolicy=NAME     Use page replacement policy NAME: clock\n"
+          "                     (default), wsclock, aging, 2q or arc.\n"
+          "  -vmtrace           Trace page faults to the scratch disk.\n"
+          "  -rsslimit=COUNT    Limit each process to COUNT resident pages.\n"
+          "  -stacklimit=COUNT  Let each process's stack grow to COUNT pages.\n"
 #endif
           );
   power_off ();
@@ -438,6 +522,9 @@ power_off (void)
 #ifdef FILESYS
   filesys_done ();
 #endif
+#ifdef VM
+  trace_done ();
+#endif
 
   print_stats ();
 
@@ -457,6 +544,7 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
 #endif
@@ -464,5 +552,11 @@ print_stats (void)
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  pagedir_print_stats ();
+#endif
+#ifdef VM
+  swap_print_stats ();
+  page_print_stats ();
+  pageout_print_stats ();
 #endif
 }
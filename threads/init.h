@@ -17,5 +17,6 @@ extern bool power_off_when_done;
 
 void power_off (void) NO_RETURN;
 void reboot (void);
+uint32_t cpu_features (void);
 
 #endif /* threads/init.h */
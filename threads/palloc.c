@@ -8,9 +8,13 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,15 +27,41 @@
    even if user processes are swapping like mad.
 
    By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just okey for demonstration purposes. */
+   half to the user pool at boot.  The split is not fixed: free
+   memory is cut into ranges of RANGE_PAGES pages, each owned by
+   one pool at a time.  A pool whose free pages drop below its low
+   watermark borrows a completely free range from the other pool,
+   as long as the lender keeps at least its high watermark of free
+   pages.  If an allocation fails outright, the pool borrows any
+   completely free range, except that the kernel pool always keeps
+   its low watermark of free pages for itself.  Ranges that were
+   lent are reclaimed first, so memory drifts back to its original
+   pool once the pressure is gone.
+
+   A range lent to the user pool may never become completely free
+   while processes keep its frames busy.  When a kernel allocation
+   fails and nothing is free to borrow, the kernel pool takes such
+   a range back at once, and the VM moves or drops the user pages
+   still in it (see frame_evacuate()); their frames are freed into
+   the kernel pool. */
+
+/* Number of pages in a range, the unit of lending. */
+#define RANGE_PAGES 16
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for debugging. */
+    size_t page_cnt;                    /* Pages in owned ranges. */
+    size_t free_cnt;                    /* Free pages in owned ranges. */
+    size_t max_pages;                   /* Upper bound on PAGE_CNT. */
+    size_t low_wmark;                   /* Borrow below this many free. */
+    size_t high_wmark;                  /* Lend only above this many free. */
+    size_t free_ranges;                 /* Owned ranges with no page used. */
+    size_t borrow_cnt;                  /* Ranges borrowed so far. */
+    size_t reclaim_cnt;                 /* Ranges taken back in use. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,9 +70,27 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+/* Pages managed by the allocator, shared by both pools.
+   Each pool's used_map spans all of them; pages in ranges owned
+   by the other pool are always marked used. */
+static uint8_t *pages_base;             /* First page. */
+static size_t pages_cnt;                /* Number of pages. */
+
+/* Range bookkeeping. */
+static size_t range_cnt;                /* Number of ranges. */
+static struct pool **range_owner;       /* Current owner of each range. */
+static struct pool **range_home;        /* Owner of each range at boot. */
+static uint8_t *range_used;             /* Allocated pages in each range. */
+
+static void init_pool (struct pool *, const char *name, size_t first_range,
+                       size_t last_range, size_t max_pages);
+static struct pool *pool_of_page (void *page);
+static bool pool_borrow (struct pool *, bool urgent);
+#ifdef VM
+static bool pool_reclaim (void);
+#endif
+static void count_pages (size_t page_idx, size_t page_cnt, bool used);
+static size_t range_size (size_t range);
 
 /* Initializes the page allocator. */
 void
@@ -56,16 +104,46 @@ palloc_init (void)
   uint8_t *free_start = pg_round_up (&_end);
   uint8_t *free_end = ptov (ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
+  size_t bm_size = bitmap_buf_size (free_pages);
+  size_t range_max = DIV_ROUND_UP (free_pages, RANGE_PAGES);
+  size_t meta_pages, user_pages, user_ranges;
+  uint8_t *meta;
+
+  /* Put both bitmaps and the range tables at the start of free
+     memory and subtract them from what the pools may hand out. */
+  meta_pages = DIV_ROUND_UP (2 * bm_size
+                             + 2 * range_max * sizeof *range_owner
+                             + range_max * sizeof *range_used, PGSIZE);
+  if (meta_pages >= free_pages)
+    PANIC ("Not enough memory for page allocator bitmaps.");
+  pages_base = free_start + meta_pages * PGSIZE;
+  pages_cnt = free_pages - meta_pages;
+  range_cnt = DIV_ROUND_UP (pages_cnt, RANGE_PAGES);
+
+  meta = free_start;
+  kernel_pool.used_map = bitmap_create_in_buf (pages_cnt, meta, bm_size);
+  meta += bm_size;
+  user_pool.used_map = bitmap_create_in_buf (pages_cnt, meta, bm_size);
+  meta += bm_size;
+  range_owner = (struct pool **) meta;
+  range_home = range_owner + range_cnt;
+  range_used = (uint8_t *) (range_home + range_cnt);
+  memset (range_used, 0, range_cnt * sizeof *range_used);
+
+  /* Give half of memory to kernel, half to user.  The user pool
+     takes whole ranges from the top, so that the kernel keeps the
+     low memory that is mapped while paging_init() runs. */
+  user_pages = pages_cnt / 2;
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  user_ranges = user_pages / RANGE_PAGES;
+  if (user_ranges == 0 && user_pages > 0)
+    user_ranges = 1;
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  init_pool (&kernel_pool, "kernel pool", 0, range_cnt - user_ranges,
+             SIZE_MAX);
+  init_pool (&user_pool, "user pool", range_cnt - user_ranges, range_cnt,
+             user_page_limit);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -78,18 +156,55 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
+#ifdef VM
+  bool reclaimed = false;
+#endif
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  for (;;)
+    {
+      lock_acquire (&pool->lock);
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      if (page_idx != BITMAP_ERROR)
+        {
+          old_level = intr_disable ();
+          pool->free_cnt -= page_cnt;
+          count_pages (page_idx, page_cnt, true);
+          intr_set_level (old_level);
+        }
+      lock_release (&pool->lock);
+
+      /* On failure, take a range from the other pool and retry. */
+      if (page_idx != BITMAP_ERROR)
+        break;
+      if (!pool_borrow (pool, true))
+        {
+#ifdef VM
+          /* Failing that, the kernel takes back a range it lent,
+             once per allocation, so that a single failure cannot
+             strip the user pool of every lent range. */
+          if (pool == &kernel_pool && !reclaimed)
+            {
+              reclaimed = true;
+              if (pool_reclaim ())
+                continue;
+            }
+#endif
+          break;
+        }
+    }
+
+  /* Running low: top up before the next allocation has to fail. */
+  if (page_idx != BITMAP_ERROR && pool->free_cnt < pool->low_wmark)
+    pool_borrow (pool, false);
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    pages = pages_base + PGSIZE * page_idx;
   else
     pages = NULL;
 
@@ -125,27 +240,28 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
-
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  pool = pool_of_page (pages);
+  page_idx = pg_no (pages) - pg_no (pages_base);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  /* We may be called with interrupts off from schedule_tail(),
+     so we can't take the pool lock here. */
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+  count_pages (page_idx, page_cnt, false);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -155,35 +271,235 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
-static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+/* Returns the number of free pages currently in the user pool
+   if FLAGS includes PAL_USER, otherwise in the kernel pool. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
 {
-  /* We'll put pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  return (flags & PAL_USER ? &user_pool : &kernel_pool)->free_cnt;
+}
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Palloc: kernel pool %zu pages (%zu borrowed ranges, "
+          "%zu reclaimed), user pool %zu pages (%zu borrowed ranges)\n",
+          kernel_pool.page_cnt, kernel_pool.borrow_cnt,
+          kernel_pool.reclaim_cnt, user_pool.page_cnt, user_pool.borrow_cnt);
+}
+
+/* Initializes pool P as owning ranges FIRST_RANGE up to but not
+   including LAST_RANGE, naming it NAME for debugging purposes.
+   The pool never grows past MAX_PAGES pages by borrowing. */
+static void
+init_pool (struct pool *p, const char *name, size_t first_range,
+           size_t last_range, size_t max_pages) 
+{
+  size_t i;
 
-  /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  p->page_cnt = 0;
+  p->max_pages = max_pages;
+  p->free_ranges = 0;
+  p->borrow_cnt = 0;
+  p->reclaim_cnt = 0;
+
+  /* All pages start out used; the pool's own ranges are freed. */
+  bitmap_set_all (p->used_map, true);
+  for (i = first_range; i < last_range; i++)
+    {
+      range_owner[i] = range_home[i] = p;
+      bitmap_set_multiple (p->used_map, i * RANGE_PAGES, range_size (i),
+                           false);
+      p->page_cnt += range_size (i);
+      p->free_ranges++;
+    }
+  p->free_cnt = p->page_cnt;
+
+  /* Keep one range in hand, and lend only while an eighth of our
+     boot-time size stays free. */
+  p->low_wmark = RANGE_PAGES;
+  p->high_wmark = p->page_cnt / 8 + RANGE_PAGES;
+
+  printf ("%zu pages available in %s.\n", p->page_cnt, name);
 }
 
-/* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
+/* Returns the pool that owns PAGE. */
+static struct pool *
+pool_of_page (void *page) 
+{
+  size_t page_idx = pg_no (page) - pg_no (pages_base);
+
+  ASSERT ((uint8_t *) page >= pages_base && page_idx < pages_cnt);
+  return range_owner[page_idx / RANGE_PAGES];
+}
+
+/* Adds PAGE_CNT pages starting at PAGE_IDX to the allocated
+   page counts of their ranges if USED is true, or subtracts them
+   otherwise, keeping the owners' free_ranges up to date.  Call
+   with interrupts off. */
+static void
+count_pages (size_t page_idx, size_t page_cnt, bool used) 
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = page_idx; i < page_idx + page_cnt; i++)
+    {
+      size_t range = i / RANGE_PAGES;
+
+      if (used)
+        {
+          if (range_used[range]++ == 0)
+            range_owner[range]->free_ranges--;
+        }
+      else
+        {
+          ASSERT (range_used[range] > 0);
+          if (--range_used[range] == 0)
+            range_owner[range]->free_ranges++;
+        }
+    }
+}
+
+/* Returns the number of pages in RANGE.  Only the last range
+   may be short. */
+static size_t
+range_size (size_t range) 
+{
+  size_t first = range * RANGE_PAGES;
+  return pages_cnt - first < RANGE_PAGES ? pages_cnt - first : RANGE_PAGES;
+}
+
+/* Moves one completely free range from the other pool into
+   POOL.  Ranges that POOL owned at boot are taken back first.
+   Unless URGENT, the other pool only gives up a range if it is
+   left with at least its high watermark of free pages; even if
+   URGENT, the kernel pool keeps its low watermark.  Returns true
+   if a range was moved, false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+pool_borrow (struct pool *pool, bool urgent) 
 {
-  size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  struct pool *lender = pool == &kernel_pool ? &user_pool : &kernel_pool;
+  size_t keep = (!urgent ? lender->high_wmark
+                 : lender == &kernel_pool ? lender->low_wmark : 0);
+  enum intr_level old_level;
+  size_t best = SIZE_MAX;
+  size_t i;
+
+  /* Most calls find nothing to borrow.  Say so without taking
+     the locks or scanning the ranges; the checks are repeated
+     below under the locks. */
+  if (lender->free_ranges == 0 || lender->free_cnt < keep + RANGE_PAGES)
+    return false;
+
+  /* Always lock the kernel pool first to avoid deadlock. */
+  lock_acquire (&kernel_pool.lock);
+  lock_acquire (&user_pool.lock);
+
+  for (i = 0; i < range_cnt; i++)
+    {
+      size_t size = range_size (i);
 
-  return page_no >= start_page && page_no < end_page;
+      if (range_owner[i] != lender
+          || pool->page_cnt + size > pool->max_pages
+          || lender->free_cnt < keep + size
+          || range_used[i] != 0)
+        continue;
+
+      best = i;
+      if (range_home[i] == pool)
+        break;
+    }
+
+  if (best != SIZE_MAX)
+    {
+      size_t size = range_size (best);
+
+      /* A free range contains no allocated pages, so nothing can
+         be freed into it while we move it; still keep the counters
+         consistent with palloc_free_multiple(). */
+      old_level = intr_disable ();
+      bitmap_set_multiple (lender->used_map, best * RANGE_PAGES, size, true);
+      bitmap_set_multiple (pool->used_map, best * RANGE_PAGES, size, false);
+      range_owner[best] = pool;
+      lender->page_cnt -= size;
+      lender->free_cnt -= size;
+      lender->free_ranges--;
+      pool->page_cnt += size;
+      pool->free_cnt += size;
+      pool->free_ranges++;
+      intr_set_level (old_level);
+      pool->borrow_cnt++;
+    }
+
+  lock_release (&user_pool.lock);
+  lock_release (&kernel_pool.lock);
+
+  return best != SIZE_MAX;
 }
+
+#ifdef VM
+/* Takes back a range that the kernel pool lent to the user pool,
+   even though the range still has pages in use, and asks the VM
+   to empty it.  Only the kernel does this, since user pages can be
+   moved elsewhere and kernel pages cannot.  Of the lent ranges,
+   the one with the fewest pages in use is taken.  Those pages
+   stay allocated, now in the kernel pool, and are freed into it
+   as the VM lets go of them.  Returns true if the kernel pool
+   gained free pages, false if it has no range lent out or the
+   one it took back could not be emptied at all. */
+static bool
+pool_reclaim (void) 
+{
+  struct pool *pool = &kernel_pool, *lender = &user_pool;
+  enum intr_level old_level;
+  size_t best = SIZE_MAX;
+  size_t first = 0, size = 0, free_pages = 0;
+  size_t i;
+
+  lock_acquire (&kernel_pool.lock);
+  lock_acquire (&user_pool.lock);
+
+  for (i = 0; i < range_cnt; i++)
+    if (range_owner[i] == lender && range_home[i] == pool
+        && (best == SIZE_MAX || range_used[i] < range_used[best]))
+      best = i;
+
+  if (best != SIZE_MAX)
+    {
+      first = best * RANGE_PAGES;
+      size = range_size (best);
+      free_pages = size - range_used[best];
+
+      /* Pages in use stay used, now charged to the kernel pool. */
+      old_level = intr_disable ();
+      for (i = first; i < first + size; i++)
+        bitmap_set (pool->used_map, i, bitmap_test (lender->used_map, i));
+      bitmap_set_multiple (lender->used_map, first, size, true);
+      range_owner[best] = pool;
+      lender->page_cnt -= size;
+      lender->free_cnt -= free_pages;
+      pool->page_cnt += size;
+      pool->free_cnt += free_pages;
+      if (range_used[best] == 0)
+        {
+          lender->free_ranges--;
+          pool->free_ranges++;
+        }
+      intr_set_level (old_level);
+      pool->reclaim_cnt++;
+    }
+
+  lock_release (&user_pool.lock);
+  lock_release (&kernel_pool.lock);
+
+  if (best == SIZE_MAX)
+    return false;
+  return free_pages > 0 || frame_evacuate (pages_base + first * PGSIZE,
+                                           size) > 0;
+}
+#endif
@@ -531,8 +531,10 @@ init_thread (struct thread *t, const char *name, int priority)
   list_push_back (&all_list, &t->allelem);
   
   /* Project 4 */
-  list_init(&t->open_file_list);
   list_init(&t->children);
+#ifdef VM
+  list_init(&t->mappings);
+#endif
   
   sema_init(&t->sync_for_parent, 0);
 	sema_init(&t->sync_for_child, 0);
@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "synch.h"
@@ -107,7 +108,12 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
-    struct list open_file_list;        /* open file descriptor */
+    struct file **fds;                  /* Open files, indexed by fd. */
+    size_t fd_cnt;                      /* Number of slots in fds. */
+    struct bitmap *fd_used;             /* Fds in use. */
+    struct file *exec_file;             /* Executable, open while running. */
+    struct fault_stats *fault_stats;    /* Page faults, or null if none. */
+    void *user_esp;                     /* User stack pointer in syscall. */
 
 	struct thread *parent;
 	struct list children;
@@ -117,6 +123,27 @@ struct thread
 	struct semaphore sync_for_child; 	/* Used by parent to wait for a child. */
 #endif
 
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    unsigned ra_window;                 /* Swap readahead window, in pages. */
+    void *ra_upage;                     /* First page of last readahead. */
+    unsigned ra_cnt;                    /* Pages in last readahead. */
+    size_t rss;                         /* Pages resident in frames. */
+    size_t rss_target;                  /* Working set target, in pages. */
+    int64_t pff_start;                  /* Start of fault counting window. */
+    unsigned pff_faults;                /* Faults in the window so far. */
+    uint8_t *stack_bottom;              /* Lowest page of the stack. */
+    unsigned stack_batch;               /* Pages added on stack growth. */
+
+    /* Owned by vm/frame.c. */
+    unsigned evictions;                 /* Frames evicted to get frames. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping id to hand out. */
+#endif
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
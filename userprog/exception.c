@@ -1,6 +1,7 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -9,15 +10,31 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "userprog/pagedir.h"
+#include "userprog/usercopy.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/page.h"
 #include "vm/vm.h"
 
 /* Number of page faults that are processed. */
 static long long page_fault_cnt;
 
+/* Page faults of each class and their latencies, system-wide.
+   Per-process counts are kept in each thread's fault_stats. */
+static struct fault_stats fault_stats;
+
+/* Names of the fault classes, for printing. */
+static const char *fault_names[FAULT_TYPE_CNT] =
+  { "zero", "swap", "file", "stack", "cow", "kill" };
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static enum fault_type page_fault_resolve (void *fault_addr, void *esp,
+                                           bool not_present, bool write,
+                                           bool user);
+static void fault_record (struct fault_stats *, enum fault_type,
+                          uint64_t cycles, unsigned evictions);
+static void fault_print (const char *, const struct fault_stats *);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -73,6 +90,34 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  fault_print ("Exception", &fault_stats);
+}
+
+/* Prints the page faults of the running process. */
+void
+exception_print_process_stats (void)
+{
+  struct fault_stats *stats = thread_current ()->fault_stats;
+
+  if (stats != NULL)
+    fault_print (thread_name (), stats);
+}
+
+/* Copies the page fault statistics of the running process into
+   STATS, or the system-wide ones if GLOBAL is true. */
+void
+exception_get_stats (struct fault_stats *stats, bool global)
+{
+  struct fault_stats *src;
+  enum intr_level old_level;
+
+  src = global ? &fault_stats : thread_current ()->fault_stats;
+  old_level = intr_disable ();
+  if (src != NULL)
+    *stats = *src;
+  else
+    memset (stats, 0, sizeof *stats);
+  intr_set_level (old_level);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -116,6 +161,15 @@ kill (struct intr_frame *f)
     }
 }
 
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -135,9 +189,11 @@ page_fault (struct intr_frame *f)
   bool user;         /* True: access by user, false: access by kernel. */
 
   void *fault_addr;  /* Fault address. */
-  void *new_page;
-  void *victim;
-  struct thread *t = thread_current(), *owner;
+
+  struct thread *t = thread_current ();
+  enum fault_type type;
+  uint64_t start, cycles;
+  unsigned evictions;
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -147,6 +203,7 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  start = rdtsc ();
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
@@ -159,54 +216,131 @@ page_fault (struct intr_frame *f)
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
-  
-  /* To implement virtual memory delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
-  
-  if (!user)
+
+  /* Service the fault, counting the frames evicted to do so.  A
+     fault by the kernel on a user address, made while it accessed
+     user memory for a system call, is serviced just like one by
+     the process; the user stack pointer is the one saved when
+     the system call was entered.  A kernel thread has no user
+     address space, so nothing it faults on can be brought in. */
+  evictions = t->evictions;
+  if (user || t->pagedir != NULL)
+    type = page_fault_resolve (fault_addr, user ? f->esp : t->user_esp,
+                               not_present, write, user);
+  else
+    type = FAULT_KILL;
+  evictions = t->evictions - evictions;
+
+  cycles = rdtsc () - start;
+  fault_record (&fault_stats, type, cycles, evictions);
+  if (t->fault_stats != NULL)
+    fault_record (t->fault_stats, type, cycles, evictions);
+
+  if (type == FAULT_KILL)
   {
-    //kernel Pannic??
-    printf("Violation : Access to Kernel Space.\n");
+    if (user)
+      kill (f);
+    if (f->eip == usercopy_insn)
+    {
+      /* Bad user address passed to a system call: make
+         usercopy() return early, and the system call fail. */
+      f->eip = usercopy_fixup;
+      return;
+    }
+
+    /* Any other kernel fault that cannot be serviced is a kernel
+       bug: user memory must only be touched through usercopy()
+       or after page_pin(). */
     intr_dump_frame (f);
-    thread_exit (); 
-    return;
+    PANIC ("Kernel bug - unserviceable page fault at %p", fault_addr);
   }
-  else if(!not_present)
-  {
-    printf("Violation : Access Denied.\n");
-    kill(f);
-    return;
-  }
-  else if(!is_user_vaddr(fault_addr))
+}
+
+/* Brings in the page at FAULT_ADDR, growing the stack if that is
+   what the access looks like given user stack pointer ESP.
+   Returns the kind of fault, which is FAULT_KILL if the access
+   was bad.  USER tells whether the process itself faulted, as
+   opposed to the kernel on its behalf. */
+static enum fault_type
+page_fault_resolve (void *fault_addr, void *esp, bool not_present,
+                    bool write, bool user)
+{
+  enum fault_type type;
+
+  if(!is_user_vaddr(fault_addr))
   {
-    printf("Violation : Access Kernel Address.\n");
-    kill(f);
-    return;
+    if (user)
+      printf("Violation : Access Kernel Address.\n");
+    return FAULT_KILL;
   }
-  else if(swap_is_in_swap_table(fault_addr))
+  else if(!not_present)
   {
-    if ((new_page = palloc_get_page(PAL_USER | PAL_ZERO)) == NULL)
-    {
-      victim = select_victim_page(&owner);
-      swap_swap_out(owner, victim);
-      
-    }
-    swap_swap_in(fault_addr);
-    return;
+    /* First write to a page mapped to the shared zero page. */
+    if (write && page_in(fault_addr, true, &type))
+      return type;
+    if (user)
+      printf("Violation : Access Denied.\n");
+    return FAULT_KILL;
   }
-  else if((uintptr_t)fault_addr < f->esp)
+  else if(page_in(fault_addr, write, &type))
   {
-    kill(f);
-    return;
+    /* Zero, file or swapped-out page found in the page table. */
+    return type;
   }
-  else if((new_page = palloc_get_page(PAL_USER | PAL_ZERO)) == NULL)
+  else if(!page_grow_stack(fault_addr, esp)
+          || !page_in(fault_addr, write, &type))
   {
-    victim = select_victim_page(&owner);
-    swap_swap_out(owner, victim);
-    
-    new_page = palloc_get_page(PAL_USER | PAL_ZERO);
+    /* Not a stack access, or stack growth failed: over the stack
+       limit, or out of memory or swap. */
+    return FAULT_KILL;
   }
-  pagedir_set_page(t->pagedir, (void *)(pg_no(fault_addr) << PGBITS), new_page, write);
+  return FAULT_STACK;
 }
 
+/* Adds a fault of class TYPE that took CYCLES to service and
+   evicted EVICTIONS frames to STATS. */
+static void
+fault_record (struct fault_stats *stats, enum fault_type type,
+              uint64_t cycles, unsigned evictions)
+{
+  enum intr_level old_level;
+  uint64_t c = cycles;
+  int bucket;
+
+  for (bucket = 0; bucket < FAULT_HIST_CNT - 1 && c > 1; bucket++)
+    c >>= 1;
+
+  old_level = intr_disable ();
+  stats->count[type]++;
+  stats->cycles[type] += cycles;
+  stats->hist[type][bucket]++;
+  stats->evictions += evictions;
+  intr_set_level (old_level);
+}
+
+/* Prints STATS, each line prefixed by NAME: the count of each
+   class of fault, then the mean latency and latency histogram of
+   each class that occurred.  Histogram entries are shown as
+   2^N:COUNT. */
+static void
+fault_print (const char *name, const struct fault_stats *stats)
+{
+  int type, i;
+
+  printf ("%s: page faults:", name);
+  for (type = 0; type < FAULT_TYPE_CNT; type++)
+    printf (" %"PRIu32" %s,", stats->count[type], fault_names[type]);
+  printf (" %"PRIu32" evictions\n", stats->evictions);
+
+  for (type = 0; type < FAULT_TYPE_CNT; type++)
+    if (stats->count[type] > 0)
+      {
+        printf ("%s: %s faults: mean %"PRIu64" cycles:", name,
+                fault_names[type],
+                stats->cycles[type] / stats->count[type]);
+        for (i = 0; i < FAULT_HIST_CNT; i++)
+          if (stats->hist[type][i] > 0)
+            printf (" 2^%d:%"PRIu32, i, stats->hist[type][i]);
+        printf ("\n");
+      }
+}
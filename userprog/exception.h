@@ -1,6 +1,9 @@
 #ifndef USERPROG_EXCEPTION_H
 #define USERPROG_EXCEPTION_H
 
+#include <fault-stats.h>
+#include <stdbool.h>
+
 /* Page fault error code bits that describe the cause of the exceptions.  */
 #define PF_P 0x1    /* 0: not-present page. 1: access rights violation. */
 #define PF_W 0x2    /* 0: read, 1: write. */
@@ -8,5 +11,7 @@
 
 void exception_init (void);
 void exception_print_stats (void);
+void exception_print_process_stats (void);
+void exception_get_stats (struct fault_stats *, bool global);
 
 #endif /* userprog/exception.h */
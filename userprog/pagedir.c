@@ -1,13 +1,43 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <round.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* Number of present PTEs in each user page table, indexed by the
+   page table's physical page number.  A page table is freed as
+   soon as its last PTE is cleared and allocated again when a page
+   in its 4 MB region is next mapped, so that a sparse address
+   space does not hold on to page tables it no longer uses. */
+static uint16_t *pt_population;
+
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vpage);
+static uint16_t *pt_count (uint32_t *pt);
+
+/* TLB statistics. */
+static unsigned tlb_reloads;            /* CR3 loads. */
+static unsigned tlb_page_flushes;       /* Single pages invalidated. */
+static unsigned tlb_reloads_avoided;    /* Switches that kept CR3. */
+
+/* Page table statistics. */
+static unsigned pt_allocs;              /* Page tables allocated. */
+static unsigned pt_frees;               /* Freed when they became empty. */
+static unsigned pt_live, pt_peak;       /* In use now, and the most. */
+
+/* Allocates the page table population counts.  Call once at
+   boot, after palloc_init(). */
+void
+pagedir_init (void) 
+{
+  size_t page_cnt = DIV_ROUND_UP (ram_pages * sizeof *pt_population, PGSIZE);
+
+  pt_population = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, page_cnt);
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -42,7 +72,9 @@ pagedir_destroy (uint32_t *pd)
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
+        *pt_count (pt) = 0;
         palloc_free_page (pt);
+        pt_live--;
       }
   palloc_free_page (pd);
 }
@@ -75,6 +107,9 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
             return NULL; 
       
           *pde = pde_create (pt);
+          pt_allocs++;
+          if (++pt_live > pt_peak)
+            pt_peak = pt_live;
         }
       else
         return NULL;
@@ -112,12 +147,35 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     {
       ASSERT ((*pte & PTE_P) == 0);
       *pte = pte_create_user (kpage, writable);
+      ++*pt_count (pg_round_down (pte));
       return true;
     }
   else
     return false;
 }
 
+/* Changes the mapping of user virtual page UPAGE in PD, which
+   must be mapped, to the frame at kernel virtual address KPAGE,
+   read/write if WRITABLE is true and read-only otherwise.  The
+   accessed and dirty bits start out clear.  Unlike clearing the
+   page and setting it again, this never needs to allocate a page
+   table, so it cannot fail. */
+void
+pagedir_replace_page (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (vtop (kpage) >> PTSHIFT < ram_pages);
+
+  pte = lookup_page (pd, upage, false);
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0);
+  *pte = pte_create_user (kpage, writable);
+  invalidate_page (pd, upage);
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -138,12 +196,13 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
-   bits in the page table entry are preserved.
+   bits in the page table entry are preserved, unless UPAGE was
+   the last page mapped in its page table, which is then freed.
    UPAGE need not be mapped. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
-  uint32_t *pte;
+  uint32_t *pte, *pt;
 
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
@@ -152,7 +211,19 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      pt = pg_round_down (pte);
+      if (--*pt_count (pt) == 0)
+        {
+          /* Zero the PDE and flush it, along with any cached copy
+             of it, before the table can be reused. */
+          pd[pd_no (upage)] = 0;
+          invalidate_page (pd, upage);
+          palloc_free_page (pt);
+          pt_frees++;
+          pt_live--;
+        }
+      else
+        invalidate_page (pd, upage);
     }
 }
 
@@ -180,11 +251,27 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD, keeping the accessed and dirty bits. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -209,18 +296,30 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register.  This flushes the TLB, except for global kernel
+   mappings.
+
+   If PD is a null pointer, the current thread has no user
+   address space.  Kernel mappings are the same in every page
+   directory, so whichever one is active is kept, and the TLB
+   entries of the process that last ran stay valid if it runs
+   next.  A page directory is only freed after its process has
+   switched to base_page_dir, so it is never left active. */
 void
 pagedir_activate (uint32_t *pd) 
 {
-  if (pd == NULL)
-    pd = base_page_dir;
+  if (pd == NULL || pd == active_pd ())
+    {
+      tlb_reloads_avoided++;
+      return;
+    }
+  tlb_reloads++;
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -243,25 +342,45 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates VPAGE's TLB entry if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  The active page directory need not be the current
+   thread's: kernel threads keep the last process's active. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage) 
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)" */
-      pagedir_activate (pd);
+      /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry" and
+         [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+      asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+      tlb_page_flushes++;
     } 
 }
 
+/* Prints TLB statistics. */
+void
+pagedir_print_stats (void) 
+{
+  printf ("TLB: %u CR3 loads, %u avoided, %u single-page flushes\n",
+          tlb_reloads, tlb_reloads_avoided, tlb_page_flushes);
+  printf ("Page tables: %u allocated, %u freed when empty, %u peak\n",
+          pt_allocs, pt_frees, pt_peak);
+}
+
+/* Returns the population count of user page table PT. */
+static uint16_t *
+pt_count (uint32_t *pt) 
+{
+  return &pt_population[vtop (pt) >> PGBITS];
+}
+
 
 bool
 pagedir_is_writable (uint32_t *pd, const void *vpage) 
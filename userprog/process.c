@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/exception.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -15,12 +16,17 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
 #include "vm/swap.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -48,6 +54,77 @@ process_execute (const char *file_name)
   return tid;
 }
 
+/* Handed from process_fork() to the child it creates. */
+struct fork_args
+  {
+    struct thread *parent;              /* Process being forked. */
+    struct intr_frame if_;              /* Parent's user context. */
+    struct semaphore done;              /* Upped once the child is set up. */
+    bool success;                       /* Whether it was. */
+  };
+
+/* Starts a new process that is a copy of the current one.  The
+   child resumes from the user context IF_, with 0 as the return
+   value.  Its memory is shared with the parent copy-on-write and
+   its open files are duplicated.  Returns the child's thread id,
+   or TID_ERROR if it could not be created. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct fork_args args;
+  tid_t tid;
+
+  args.parent = thread_current ();
+  args.if_ = *if_;
+  sema_init (&args.done, 0);
+  args.success = false;
+
+  tid = thread_create (args.parent->name, PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&args.done);
+  return args.success ? tid : TID_ERROR;
+}
+
+/* A thread function that copies the parent's address space and
+   open files and starts the copy running. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = args->if_;
+  bool success = false;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL || !page_table_create ())
+    goto done;
+  t->fault_stats = calloc (1, sizeof *t->fault_stats);
+  if (t->fault_stats == NULL)
+    goto done;
+  process_activate ();
+
+  t->exec_file = file_reopen (args->parent->exec_file);
+  if (t->exec_file == NULL)
+    goto done;
+  file_deny_write (t->exec_file);
+
+  success = (page_table_copy (args->parent)
+             && file_copy_fd_table (args->parent));
+
+ done:
+  /* ARGS lives on the parent's stack, which may be gone once
+     the parent is woken. */
+  args->success = success;
+  sema_up (&args->done);
+  if (!success)
+    thread_exit ();
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 static int argument_parsing (char *buffer, char *esp);
 
 /* A thread function that loads a user process and starts it
@@ -69,9 +146,14 @@ start_process (void *file_name_)
   strlcpy(buffer, file_name_, LOADER_ARGS_LEN);
   file_name = strtok_r(buffer, " ", &saveptr);
   success = load (file_name, &if_.eip, &if_.esp);
-  length = argument_parsing(file_name_, if_.esp);
-  if_.esp = if_.esp - length;
-  memcpy(if_.esp, file_name_, length);
+  if (success)
+  {
+    /* The stack page was left pinned by setup_stack(). */
+    length = argument_parsing(file_name_, if_.esp);
+    if_.esp = if_.esp - length;
+    memcpy(if_.esp, file_name_, length);
+    page_unpin (if_.esp, length);
+  }
 
   /* If load failed, quit. */
   palloc_free_page (file_name_);
@@ -222,11 +304,7 @@ process_exit (void)
   if (cur->parent != NULL)
     list_remove (&cur->siblings);
   
-  while(!list_empty(&cur->open_file_list))
-  {
-    file_close_with_list_elem(list_pop_front(&cur->open_file_list));
-    
-  }  
+  file_close_fd_table ();
 	sema_up(&cur->sync_for_child);
 
   /* Destroys the current process's page directory and switch back
@@ -234,8 +312,11 @@ process_exit (void)
   pd = cur->pagedir;
   if (pd != NULL) 
     {
-      swap_release_swaped_page_of(cur->tid);
-      swap_print_stats();
+      mmap_unmap_all ();
+      page_table_destroy ();
+      exception_print_process_stats ();
+      free (cur->fault_stats);
+      cur->fault_stats = NULL;
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -244,10 +325,13 @@ process_exit (void)
          directory, or our active page directory will be one
          that's been freed (and cleared). */
       cur->pagedir = NULL;
-      remove_pagedir(cur);
-      pagedir_activate (NULL);
+      pagedir_activate (base_page_dir);
       pagedir_destroy (pd);
     }
+
+  /* Pages can no longer be read from the executable. */
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -325,9 +409,9 @@ struct Elf32_Phdr
 #define PT_STACK   0x6474e551   /* Stack segment. */
 
 /* Flags for p_flags.  See [ELF3] 2-3 and 2-4. */
-#define PF_X 1          /* Executable. */
-#define PF_W 2          /* Writable. */
-#define PF_R 4          /* Readable. */
+#define PHF_X 1         /* Executable. */
+#define PHF_W 2         /* Writable. */
+#define PHF_R 4         /* Readable. */
 
 static bool setup_stack (void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
@@ -351,11 +435,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   /* Allocate and activate page directories. */
   t->pagedir = pagedir_create ();
-  if (t->pagedir == NULL) 
+  if (t->pagedir == NULL || !page_table_create ()) 
+    goto done;
+  t->fault_stats = calloc (1, sizeof *t->fault_stats);
+  if (t->fault_stats == NULL)
     goto done;
-
-  // add to pagedir_list
-  add_pagedir(t);
 
   process_activate ();
 
@@ -411,7 +495,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
       case PT_LOAD:
         if (validate_segment (&phdr, file)) 
         {
-          bool writable = (phdr.p_flags & PF_W) != 0;
+          bool writable = (phdr.p_flags & PHF_W) != 0;
           uint32_t file_page = phdr.p_offset & ~PGMASK;
           uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
           uint32_t page_offset = phdr.p_vaddr & PGMASK;
@@ -451,16 +535,18 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
 done:
-  /* We arrive here whether the load is successful or not. */
-  if (file != NULL) file_allow_write(file);
-  file_close (file);
+  /* We arrive here whether the load is successful or not.
+     On success the executable stays open, and unwritable, until
+     process_exit(): its pages are only read in on first touch. */
+  if (success)
+    t->exec_file = file;
+  else
+    file_close (file);
   return success;
 }
   
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -517,9 +603,13 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
  
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
+
+   Nothing is read here.  Each page is only recorded in the
+   supplemental page table, and page_fault() reads or zeroes it
+   on first touch.
  
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   occurs or the segment overlaps a page already loaded. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -528,7 +618,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
   {
     /* Calculate how to fill this page.
@@ -537,70 +626,32 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
     size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-    /* Get a page from memory. */
-    uint8_t *kpage = palloc_get_page (PAL_USER);
-    if (kpage == NULL)
+    /* Record the page for demand loading. */
+    if (page_read_bytes > 0
+        ? !page_add_file (upage, file, ofs, page_read_bytes, writable)
+        : !page_add_zero (upage, writable))
       return false;
 
-    /* Load this page. */
-    if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-    {
-      palloc_free_page (kpage);
-      return false; 
-    }
-    memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-    /* Add the page to the process's address space. */
-    if (!install_page (upage, kpage, writable)) 
-    {
-      palloc_free_page (kpage);
-      return false; 
-    }
-
     /* Advance. */
     read_bytes -= page_read_bytes;
     zero_bytes -= page_zero_bytes;
+    ofs += page_read_bytes;
     upage += PGSIZE;
   }
   return true;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+   user virtual memory.  The page is left pinned so that the
+   arguments can be copied onto it; start_process() unpins it. */
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
-  bool success = false;
-
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
-  {
-    success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-    if (success)
-      *esp = PHYS_BASE;
-    else
-      palloc_free_page (kpage);
-  }
-  return success;
-}
-
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
-{
-  struct thread *t = thread_current ();
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
 
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+  if (!page_grow_stack (upage, upage)
+      || !page_pin (upage, PGSIZE, true))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
 }
@@ -1,43 +1,58 @@
+#include "userprog/exception.h"
+#include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "userprog/tss.h"
+#include "userprog/usercopy.h"
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <console.h>
+#include "threads/flags.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "devices/input.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
 
 /* This is a skeleton system call handler */
 
-static void syscall_handler (struct intr_frame *);
-static void sys_halt (struct intr_frame *);
-static void sys_exit (struct intr_frame *);
-static void sys_exec (struct intr_frame *);
-static void sys_wait (struct intr_frame *);
-static void sys_create (struct intr_frame *);
-static void sys_remove (struct intr_frame *);
-static void sys_open (struct intr_frame *);
-static void sys_filesize (struct intr_frame *);
-static void sys_read (struct intr_frame *);
-static void sys_write (struct intr_frame *);
-static void sys_seek (struct intr_frame *);
-static void sys_tell (struct intr_frame *);
-static void sys_close (struct intr_frame *);
-static void sys_mmap (struct intr_frame *);
-static void sys_munmap (struct intr_frame *);
-static void sys_chdir (struct intr_frame *);
-static void sys_mkdir (struct intr_frame *);
-static void sys_readdir (struct intr_frame *);
-static void sys_isdir (struct intr_frame *);
-static void sys_inumber (struct intr_frame *);
-
-static void *is_valid_virtual_address(const void *);
-
-static void (*syscall_table[SYS_LAST])(struct intr_frame *f_) =
+static void sys_halt (struct intr_frame *, const unsigned *args);
+static void sys_exit (struct intr_frame *, const unsigned *args);
+static void sys_exec (struct intr_frame *, const unsigned *args);
+static void sys_wait (struct intr_frame *, const unsigned *args);
+static void sys_create (struct intr_frame *, const unsigned *args);
+static void sys_remove (struct intr_frame *, const unsigned *args);
+static void sys_open (struct intr_frame *, const unsigned *args);
+static void sys_filesize (struct intr_frame *, const unsigned *args);
+static void sys_read (struct intr_frame *, const unsigned *args);
+static void sys_write (struct intr_frame *, const unsigned *args);
+static void sys_seek (struct intr_frame *, const unsigned *args);
+static void sys_tell (struct intr_frame *, const unsigned *args);
+static void sys_close (struct intr_frame *, const unsigned *args);
+static void sys_mmap (struct intr_frame *, const unsigned *args);
+static void sys_munmap (struct intr_frame *, const unsigned *args);
+static void sys_chdir (struct intr_frame *, const unsigned *args);
+static void sys_mkdir (struct intr_frame *, const unsigned *args);
+static void sys_readdir (struct intr_frame *, const unsigned *args);
+static void sys_isdir (struct intr_frame *, const unsigned *args);
+static void sys_inumber (struct intr_frame *, const unsigned *args);
+static void sys_fork (struct intr_frame *, const unsigned *args);
+static void sys_madvise (struct intr_frame *, const unsigned *args);
+static void sys_faultstat (struct intr_frame *, const unsigned *args);
+
+static void exit_process (int status) NO_RETURN;
+static bool get_file_name (char name[NAME_MAX + 1], const char *uname);
+static int transfer (struct file *, char *buffer, unsigned size, bool read);
+
+static void (*syscall_table[SYS_LAST])(struct intr_frame *f_,
+                                      const unsigned *args) =
 { /* Projects 2 and later. */
   /* 0 : SYS_HALT */      sys_halt,       /* Halt the operating system. */
   /* 1 : SYS_EXIT */      sys_exit,       /* Terminate this process. */
@@ -63,100 +78,164 @@ static void (*syscall_table[SYS_LAST])(struct intr_frame *f_) =
   /* 17 : SYS_READDIR */  sys_readdir,       /* Reads a directory entry. */
   /* 18 : SYS_ISDIR */    sys_isdir,       /* Tests if a fd represents a directory. */
   /* 19 : SYS_INUMBER */  sys_inumber,       /* Returns the inode number for a fd. */
+
+  /* Extensions. */
+  /* 20 : SYS_FORK */     sys_fork,       /* Duplicate this process. */
+  /* 21 : SYS_MADVISE */  sys_madvise,       /* Give advice about memory use. */
+  /* 22 : SYS_FAULTSTAT */ sys_faultstat,    /* Get page fault statistics. */
+};
+
+/* Number of 32-bit arguments each system call takes, after the
+   system call number. */
+static const int syscall_argc[SYS_LAST] =
+{
+  0, 1, 1, 1, 2, 1, 1, 1, 3, 3, 2, 1, 1,        /* SYS_HALT ... SYS_CLOSE */
+  2, 1,                                         /* SYS_MMAP, SYS_MUNMAP */
+  1, 1, 2, 1, 1,                                /* SYS_CHDIR ... SYS_INUMBER */
+  0, 3, 2,                                      /* SYS_FORK ... SYS_FAULTSTAT */
 };
 
 
+/* Model-specific registers for SYSENTER.  See [IA32-v3a] 4.8.7
+   "Fast System Calls". */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+/* Entry point for SYSENTER, in sysenter.S. */
+void sysenter_entry (void);
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/* System calls come in through `int $0x30' and, on CPUs that
+   have it, also through SYSENTER, which skips the generic
+   interrupt entry and exit.  lib/user/syscall.c uses SYSENTER
+   whenever CPUID says the CPU has it, so this must enable it in
+   exactly that case. */
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  if (cpu_features () & CPUID_SEP)
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_ESP, (uint32_t) tss_get_esp0 ());
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
 }
 
-static void
+/* Handles system call F, whether it came in through `int $0x30'
+   or through SYSENTER. */
+void
 syscall_handler (struct intr_frame *f)
 {
-  void (*function)() = syscall_table[*(int *)(f->esp)];
-  if (*function != NULL) (*function)(f);
+  unsigned int args[3];
+  int number;
+
+  /* The system call number and arguments must all be in user
+     memory.  Copying them in checks that, and brings in any that
+     are not resident; the handlers then only use the copies. */
+  thread_current()->user_esp = f->esp;
+  if (!copy_from_user(&number, f->esp, sizeof number)
+      || number < 0 || number >= SYS_LAST
+      || !copy_from_user(args, (int *) f->esp + 1,
+                         syscall_argc[number] * sizeof *args))
+    exit_process(-1);
+
+  if (syscall_table[number] != NULL) syscall_table[number](f, args);
 }
 
 /* system calls. */
-static void sys_halt (struct intr_frame *f_) 
+static void sys_halt (struct intr_frame *f_, const unsigned *args UNUSED) 
 {
   power_off();
 }
 
-static void sys_exit(struct intr_frame *f_)
+static void sys_exit(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  int status = *(esp + 1);
-  struct thread *t = thread_current();
-  printf("%s:exit(%d)\n", t->name, status);
-  thread_exit ();
+  exit_process((int) args[0]);
 }
 
-static void sys_exec(struct intr_frame *f_)
+static void sys_exec(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  const char *file = is_valid_virtual_address(*(esp + 1));
+  const char *ufile = (const char *) args[0];
+  char *file = palloc_get_page(0);
+  int len;
   
-  f_->eax = process_execute(file);
+  if (file == NULL)
+  {
+    f_->eax = TID_ERROR;
+    return;
+  }
+  len = copy_string_from_user(file, ufile, PGSIZE);
+  if (len < 0)
+  {
+    palloc_free_page(file);
+    exit_process(-1);
+  }
+  f_->eax = len < PGSIZE ? process_execute(file) : TID_ERROR;
+  palloc_free_page(file);
 }
 
-static void sys_wait(struct intr_frame *f_)
+static void sys_fork(struct intr_frame *f_, const unsigned *args UNUSED)
 {
-  unsigned int *esp = f_->esp;
-  int pid = *(esp + 1);
-  
-  f_->eax = process_wait(pid);
+  f_->eax = process_fork(f_);
+}
+
+static void sys_wait(struct intr_frame *f_, const unsigned *args)
+{
+  f_->eax = process_wait((int) args[0]);
 }
 
-static void sys_create(struct intr_frame *f_)
+static void sys_create(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  char *file = is_valid_virtual_address(*(esp + 1));
-  unsigned int initial_size = *(esp + 2);
+  char file[NAME_MAX + 1];
   
-  if (initial_size < 0) f_->eax = -1;
-  else f_->eax = filesys_create(file, initial_size);
+  f_->eax = get_file_name(file, (const char *) args[0])
+            && filesys_create(file, args[1]);
 }
 
-static void sys_remove(struct intr_frame *f_)
+static void sys_remove(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  char *file = is_valid_virtual_address(*(esp + 1));
+  char file[NAME_MAX + 1];
   
-  f_->eax = filesys_remove(file);
+  f_->eax = get_file_name(file, (const char *) args[0])
+            && filesys_remove(file);
 }
 
-static void sys_open(struct intr_frame *f_)
+static void sys_open(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  char *file = is_valid_virtual_address(*(esp + 1));
-  struct file *f = filesys_open(file);
+  char file[NAME_MAX + 1];
+  struct file *f = NULL;
     
+  if (get_file_name(file, (const char *) args[0]))
+    f = filesys_open(file);
   if (f == NULL) f_->eax = -1;
   else 
   {
     f_->eax = file_insert_in_fd(f);
+    if ((int) f_->eax < 0) file_close(f);
   }
 }
 
-static void sys_filesize(struct intr_frame *f_)
+static void sys_filesize(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  int fd = *(esp + 1);
-  struct file *f = file_search_in_fd(fd);
+  struct file *f = file_search_in_fd((int) args[0]);
     
   if (f == NULL) f_->eax = -1;
   else f_->eax = file_length(f);  
 }
 
-static void sys_read(struct intr_frame *f_)
+static void sys_read(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  int fd = *(esp + 1);
-  char *buffer = is_valid_virtual_address(*(esp + 2));
-  unsigned int size = *(esp + 3);
+  int fd = args[0];
+  char *buffer = (char *) args[1];
+  unsigned int size = args[2];
   struct file *f;
   
   if (fd == STDIN_FILENO) f_->eax = input_getc();
@@ -165,40 +244,38 @@ static void sys_read(struct intr_frame *f_)
   {
     f = file_search_in_fd(fd);
     if (f == NULL) f_->eax = -1;
-    else f_->eax = file_read(f, buffer, size);
+    else f_->eax = transfer(f, buffer, size, true);
   }
 }
 
-static void sys_write(struct intr_frame *f_)
+static void sys_write(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  int fd = *(esp + 1);
-  char *buffer = is_valid_virtual_address(*(esp + 2));
-  unsigned int size = *(esp + 3);
+  int fd = args[0];
+  char *buffer = (char *) args[1];
+  unsigned int size = args[2];
   struct file *f;
   
-  if (fd == STDOUT_FILENO) putbuf(buffer, size);
+  if (fd == STDOUT_FILENO) f_->eax = transfer(NULL, buffer, size, false);
   else if (fd < 3) f_->eax = -1;
   else
   {
     f = file_search_in_fd(fd);
     if (f == NULL) f_->eax = -1;
-    else f_->eax = file_write(f, buffer, size);
+    else f_->eax = transfer(f, buffer, size, false);
   }
 }
 
-static void sys_seek(struct intr_frame *f_)
+static void sys_seek(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_tell(struct intr_frame *f_)
+static void sys_tell(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_close(struct intr_frame *f_)
+static void sys_close(struct intr_frame *f_, const unsigned *args)
 {
-  unsigned int *esp = f_->esp;
-  int fd = *(esp + 1);
+  int fd = args[0];
   struct file *f = file_search_in_fd(fd);
   
   if (f != NULL) 
@@ -208,35 +285,102 @@ static void sys_close(struct intr_frame *f_)
   }
 }
 
-static void sys_mmap(struct intr_frame *f_)
+static void sys_mmap(struct intr_frame *f_, const unsigned *args)
+{
+  struct file *f = file_search_in_fd((int) args[0]);
+  
+  if (f == NULL) f_->eax = MAP_FAILED;
+  else f_->eax = mmap_map(f, (void *) args[1]);
+}
+
+static void sys_munmap(struct intr_frame *f_, const unsigned *args)
+{
+  mmap_unmap((mapid_t) args[0]);
+}
+
+static void sys_madvise(struct intr_frame *f_, const unsigned *args)
+{
+  f_->eax = page_advise((void *) args[0], args[1], (int) args[2]) ? 0 : -1;
+}
+
+static void sys_faultstat(struct intr_frame *f_, const unsigned *args)
+{
+  struct fault_stats *ustats = (struct fault_stats *) args[0];
+  bool global = args[1] != 0;
+  struct fault_stats stats;
+  
+  exception_get_stats(&stats, global);
+  f_->eax = copy_to_user(ustats, &stats, sizeof stats);
+}
+
+static void sys_chdir(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_munmap(struct intr_frame *f_)
+static void sys_mkdir(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_chdir(struct intr_frame *f_)
+static void sys_readdir(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_mkdir(struct intr_frame *f_)
+static void sys_isdir(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_readdir(struct intr_frame *f_)
+static void sys_inumber(struct intr_frame *f_, const unsigned *args UNUSED)
 {
 }
 
-static void sys_isdir(struct intr_frame *f_)
+/* Terminates the current process with exit status STATUS. */
+static void exit_process(int status)
 {
+  printf("%s:exit(%d)\n", thread_current()->name, status);
+  thread_exit ();
 }
 
-static void sys_inumber(struct intr_frame *f_)
+/* Copies the file name at user address UNAME into NAME.  Returns
+   false if it is too long to be a file name.  Terminates the
+   process if UNAME is not a valid string in user memory. */
+static bool get_file_name(char name[NAME_MAX + 1], const char *uname)
 {
+  int len = copy_string_from_user(name, uname, NAME_MAX + 1);
+
+  if (len < 0) exit_process(-1);
+  return len <= NAME_MAX;
 }
 
-static void *is_valid_virtual_address(const void *addr)
+/* Reads SIZE bytes from F into the user buffer at BUFFER if READ
+   is true, otherwise writes them from BUFFER to F, or to the
+   console if F is null.  Works a page at a time, pinning only that
+   page, so that a huge buffer cannot pin every user frame.
+   Returns the number of bytes transferred, which is short only if
+   F is.  Terminates the process if BUFFER is not valid user
+   memory. */
+static int transfer(struct file *f, char *buffer, unsigned size, bool read)
 {
-  return (is_user_vaddr(addr) && pagedir_get_page(thread_current()->pagedir, addr)) ? addr : NULL;
+  unsigned done = 0;
+
+  while (done < size)
+  {
+    char *p = buffer + done;
+    unsigned chunk = PGSIZE - pg_ofs(p);
+    int n;
+
+    if (chunk > size - done) chunk = size - done;
+    if (!page_pin(p, chunk, read)) exit_process(-1);
+    if (f == NULL)
+    {
+      putbuf(p, chunk);
+      n = chunk;
+    }
+    else if (read) n = file_read(f, p, chunk);
+    else n = file_write(f, p, chunk);
+    page_unpin(p, chunk);
+
+    done += n;
+    if (n < (int) chunk) break;
+  }
+  return done;
 }
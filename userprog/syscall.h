@@ -1,6 +1,9 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+struct intr_frame;
+
 void syscall_init (void);
+void syscall_handler (struct intr_frame *);
 
 #endif /* userprog/syscall.h  */
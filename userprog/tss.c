@@ -96,6 +96,17 @@ tss_get (void)
   return tss;
 }
 
+/* Returns the address of the kernel TSS's ring 0 stack pointer,
+   which tss_update() keeps pointing to the top of the running
+   thread's kernel stack.  The SYSENTER entry point loads its
+   stack pointer from here. */
+void **
+tss_get_esp0 (void) 
+{
+  ASSERT (tss != NULL);
+  return &tss->esp0;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void
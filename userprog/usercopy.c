@@ -0,0 +1,61 @@
+#include "userprog/usercopy.h"
+#include <stdint.h>
+#include <string.h>
+#include "threads/vaddr.h"
+
+/* Returns true if all SIZE bytes starting at UADDR are user
+   virtual addresses. */
+static bool
+is_user_range (const void *uaddr, size_t size) 
+{
+  uintptr_t start = (uintptr_t) uaddr;
+
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Pages that are not resident are brought in as if the
+   process had touched them.  Returns true if successful, false
+   if any of the bytes is not valid user memory. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size) 
+{
+  return is_user_range (usrc, size) && usercopy (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if any of the bytes
+   is not valid, writable user memory. */
+bool
+copy_to_user (void *udst, const void *src, size_t size) 
+{
+  return is_user_range (udst, size) && usercopy (udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes.  Returns the length of the
+   string, or SIZE if it does not fit in DST (which is then not
+   null-terminated), or -1 if the string runs into memory that is
+   not valid user memory.  Reads the string a page at a time. */
+int
+copy_string_from_user (char *dst, const char *usrc, size_t size) 
+{
+  size_t len = 0;
+
+  while (len < size) 
+    {
+      const char *usrc_page = usrc + len;
+      size_t chunk = PGSIZE - pg_ofs (usrc_page);
+      char *end;
+
+      if (chunk > size - len)
+        chunk = size - len;
+      if (!copy_from_user (dst + len, usrc_page, chunk))
+        return -1;
+      end = memchr (dst + len, '\0', chunk);
+      if (end != NULL)
+        return end - dst;
+      len += chunk;
+    }
+  return size;
+}
@@ -0,0 +1,20 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Copies between kernel and user memory, in usercopy-stub.S. */
+size_t usercopy (void *dst, const void *src, size_t size);
+
+/* Labels in usercopy() for page_fault(): the instruction that
+   touches user memory, and where it goes on a bad access.  Not
+   functions. */
+void usercopy_insn (void);
+void usercopy_fixup (void);
+
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+int copy_string_from_user (char *dst, const char *usrc, size_t size);
+
+#endif /* userprog/usercopy.h */
@@ -0,0 +1,680 @@
+/* vmtrace: replays a Pintos page fault trace against several
+   page replacement policies and Belady's optimal policy.
+
+   Boot Pintos with -vmtrace and keep the scratch disk, e.g.
+     pintos --scratch-disk=trace.dsk -- -vmtrace -q run 'prog'
+   then run
+     vmtrace trace.dsk
+   to print the number of faults each policy would take with a
+   range of memory sizes.
+
+   The trace holds only the references that faulted in the traced
+   run, not every memory access, so the replay compares policies
+   on that run's miss stream.  Results are most meaningful for
+   memory sizes no larger than the traced run's. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Must match struct trace_record and TRACE_MAGIC in vm/trace.h. */
+struct trace_record
+  {
+    uint32_t upage;
+    int32_t tid;
+    int64_t tick;
+  };
+#define TRACE_MAGIC 0x52544d56
+#define SECTOR_SIZE 512
+
+/* Ticks a page may go unused before WSClock takes it out of the
+   working set, as in vm/vm.c. */
+static int64_t ws_tau = 100;
+
+/* The trace, with each (tid, upage) pair replaced by a small
+   page number. */
+static size_t ref_cnt;
+static int *refs;
+static int64_t *ticks;
+static int page_cnt;
+
+static void read_trace (const char *file_name);
+static void number_pages (const struct trace_record *);
+
+/* Per-page state shared by the simulators. */
+static int *slot_of;            /* Page's frame, or -1. */
+static int *list_of;            /* List the page is in, or -1. */
+static int *prev, *next;        /* List links. */
+
+/* Per-frame state. */
+static int *page_in;            /* Page in the frame, or -1. */
+static unsigned char *ref_bit;
+static unsigned char *age;
+static int64_t *last_use;
+
+static void reset (int frames);
+
+/* Doubly linked lists of pages, oldest first. */
+struct plist
+  {
+    int id;
+    int head, tail;
+    int cnt;
+  };
+
+static void plist_init (struct plist *, int id);
+static void plist_push (struct plist *, int page);
+static int plist_pop (struct plist *);
+static void plist_remove (struct plist *, int page);
+
+typedef size_t simulate_func (int frames);
+
+static simulate_func sim_clock, sim_wsclock, sim_aging, sim_lru,
+  sim_2q, sim_arc, sim_opt;
+
+static const struct
+  {
+    const char *name;
+    simulate_func *simulate;
+  }
+policies[] =
+  {
+    {"clock", sim_clock},
+    {"wsclock", sim_wsclock},
+    {"aging", sim_aging},
+    {"lru", sim_lru},
+    {"2q", sim_2q},
+    {"arc", sim_arc},
+    {"opt", sim_opt},
+  };
+#define POLICY_CNT (sizeof policies / sizeof *policies)
+
+static void
+usage (const char *program_name)
+{
+  fprintf (stderr,
+           "vmtrace: replays a Pintos -vmtrace page fault trace\n"
+           "usage: %s [-f FRAMES]... [-t TAU] DISK\n"
+           "  where DISK is the scratch disk image the trace was\n"
+           "    written to, FRAMES is a memory size in pages to\n"
+           "    simulate (default: 10%%, 25%%, 50%% and 75%% of the pages\n"
+           "    in the trace), and TAU is the WSClock working set\n"
+           "    window in timer ticks (default: 100).\n",
+           program_name);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int frames[64];
+  int frame_sizes = 0;
+  const char *file_name = NULL;
+  size_t i;
+  int j;
+
+  for (j = 1; j < argc; j++)
+    {
+      if (!strcmp (argv[j], "-f") && j + 1 < argc)
+        {
+          if (frame_sizes >= (int) (sizeof frames / sizeof *frames))
+            usage (argv[0]);
+          frames[frame_sizes++] = atoi (argv[++j]);
+        }
+      else if (!strcmp (argv[j], "-t") && j + 1 < argc)
+        ws_tau = atoll (argv[++j]);
+      else if (argv[j][0] != '-' && file_name == NULL)
+        file_name = argv[j];
+      else
+        usage (argv[0]);
+    }
+  if (file_name == NULL)
+    usage (argv[0]);
+
+  read_trace (file_name);
+  printf ("%zu faults on %d distinct pages\n", ref_cnt, page_cnt);
+  if (ref_cnt == 0)
+    return EXIT_SUCCESS;
+  if (frame_sizes == 0)
+    {
+      frames[frame_sizes++] = page_cnt / 10;
+      frames[frame_sizes++] = page_cnt / 4;
+      frames[frame_sizes++] = page_cnt / 2;
+      frames[frame_sizes++] = page_cnt * 3 / 4;
+    }
+
+  printf ("%8s", "frames");
+  for (i = 0; i < POLICY_CNT; i++)
+    printf (" %10s", policies[i].name);
+  printf ("\n");
+  for (j = 0; j < frame_sizes; j++)
+    {
+      int n = frames[j] > 0 ? frames[j] : 1;
+
+      if (n > page_cnt)
+        n = page_cnt;
+
+      printf ("%8d", n);
+      for (i = 0; i < POLICY_CNT; i++)
+        {
+          reset (n);
+          printf (" %10zu", policies[i].simulate (n));
+        }
+      printf ("\n");
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Reads the trace from disk image FILE_NAME. */
+static void
+read_trace (const char *file_name)
+{
+  uint32_t header[2];
+  struct trace_record *records;
+  FILE *file;
+
+  file = fopen (file_name, "rb");
+  if (file == NULL)
+    {
+      fprintf (stderr, "%s: %s\n", file_name, strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  if (fread (header, sizeof header, 1, file) != 1
+      || header[0] != TRACE_MAGIC)
+    {
+      fprintf (stderr, "%s: not a page fault trace\n", file_name);
+      exit (EXIT_FAILURE);
+    }
+
+  ref_cnt = header[1];
+  records = malloc (ref_cnt * sizeof *records + 1);
+  refs = malloc (ref_cnt * sizeof *refs + 1);
+  ticks = malloc (ref_cnt * sizeof *ticks + 1);
+  if (records == NULL || refs == NULL || ticks == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  if (fseek (file, SECTOR_SIZE, SEEK_SET) != 0
+      || fread (records, sizeof *records, ref_cnt, file) != ref_cnt)
+    {
+      fprintf (stderr, "%s: trace is truncated\n", file_name);
+      exit (EXIT_FAILURE);
+    }
+  fclose (file);
+
+  number_pages (records);
+  free (records);
+}
+
+/* Compares trace records by page. */
+static int
+compare_records (const void *a_, const void *b_)
+{
+  const struct trace_record *a = a_;
+  const struct trace_record *b = b_;
+
+  if (a->tid != b->tid)
+    return a->tid < b->tid ? -1 : 1;
+  if (a->upage != b->upage)
+    return a->upage < b->upage ? -1 : 1;
+  return 0;
+}
+
+/* Fills in REFS and TICKS from RECORDS, numbering the distinct
+   pages from 0 to PAGE_CNT - 1, and allocates the per-page
+   arrays. */
+static void
+number_pages (const struct trace_record *records)
+{
+  struct trace_record *sorted = malloc (ref_cnt * sizeof *sorted + 1);
+  size_t i;
+
+  if (sorted == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  memcpy (sorted, records, ref_cnt * sizeof *sorted);
+  qsort (sorted, ref_cnt, sizeof *sorted, compare_records);
+
+  page_cnt = 0;
+  for (i = 0; i < ref_cnt; i++)
+    if (page_cnt == 0 || compare_records (&sorted[page_cnt - 1],
+                                          &sorted[i]) != 0)
+      sorted[page_cnt++] = sorted[i];
+
+  for (i = 0; i < ref_cnt; i++)
+    {
+      struct trace_record *r = bsearch (&records[i], sorted, page_cnt,
+                                        sizeof *sorted, compare_records);
+      refs[i] = r - sorted;
+      ticks[i] = records[i].tick;
+    }
+  free (sorted);
+
+  slot_of = malloc (page_cnt * sizeof *slot_of);
+  list_of = malloc (page_cnt * sizeof *list_of);
+  prev = malloc (page_cnt * sizeof *prev);
+  next = malloc (page_cnt * sizeof *next);
+  page_in = malloc (page_cnt * sizeof *page_in);
+  ref_bit = malloc (page_cnt);
+  age = malloc (page_cnt);
+  last_use = malloc (page_cnt * sizeof *last_use);
+  if (slot_of == NULL || list_of == NULL || prev == NULL || next == NULL
+      || page_in == NULL || ref_bit == NULL || age == NULL
+      || last_use == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+}
+
+/* Empties memory before simulating with FRAMES frames. */
+static void
+reset (int frames)
+{
+  int i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      slot_of[i] = -1;
+      list_of[i] = -1;
+    }
+  for (i = 0; i < frames && i < page_cnt; i++)
+    {
+      page_in[i] = -1;
+      ref_bit[i] = 0;
+      age[i] = 0;
+      last_use[i] = 0;
+    }
+}
+
+/* Puts PAGE in frame SLOT, evicting whatever was there. */
+static void
+load (int page, int slot, int64_t tick)
+{
+  if (page_in[slot] >= 0)
+    slot_of[page_in[slot]] = -1;
+  page_in[slot] = page;
+  slot_of[page] = slot;
+  ref_bit[slot] = 0;
+  age[slot] = 0;
+  last_use[slot] = tick;
+}
+
+/* Second chance. */
+static size_t
+sim_clock (int frames)
+{
+  size_t faults = 0, i;
+  int used = 0, hand = 0;
+
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+
+      if (slot_of[page] >= 0)
+        {
+          ref_bit[slot_of[page]] = 1;
+          continue;
+        }
+      faults++;
+      if (used < frames)
+        {
+          load (page, used++, ticks[i]);
+          continue;
+        }
+      while (ref_bit[hand])
+        {
+          ref_bit[hand] = 0;
+          hand = (hand + 1) % frames;
+        }
+      load (page, hand, ticks[i]);
+      hand = (hand + 1) % frames;
+    }
+  return faults;
+}
+
+/* WSClock, without the preference for clean pages, since the
+   trace does not record writes. */
+static size_t
+sim_wsclock (int frames)
+{
+  size_t faults = 0, i;
+  int used = 0, hand = 0;
+
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+      int victim = -1, oldest = -1, n;
+
+      if (slot_of[page] >= 0)
+        {
+          ref_bit[slot_of[page]] = 1;
+          continue;
+        }
+      faults++;
+      if (used < frames)
+        {
+          load (page, used++, ticks[i]);
+          continue;
+        }
+      for (n = 0; n < frames && victim < 0; n++)
+        {
+          int s = hand;
+
+          hand = (hand + 1) % frames;
+          if (ref_bit[s])
+            {
+              ref_bit[s] = 0;
+              last_use[s] = ticks[i];
+            }
+          else if (ticks[i] - last_use[s] > ws_tau)
+            victim = s;
+          else if (oldest < 0 || last_use[s] < last_use[oldest])
+            oldest = s;
+        }
+      if (victim < 0)
+        victim = oldest >= 0 ? oldest : hand;
+      load (page, victim, ticks[i]);
+    }
+  return faults;
+}
+
+/* Aging, with the histories shifted once per tick in which a
+   fault happens, as in vm/vm.c. */
+static size_t
+sim_aging (int frames)
+{
+  size_t faults = 0, i;
+  int64_t last_tick = -1;
+  int used = 0;
+
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+      int victim = 0, s;
+
+      if (slot_of[page] >= 0)
+        {
+          ref_bit[slot_of[page]] = 1;
+          continue;
+        }
+      faults++;
+      if (used < frames)
+        {
+          load (page, used++, ticks[i]);
+          continue;
+        }
+      for (s = 0; s < frames; s++)
+        {
+          if (ticks[i] != last_tick)
+            age[s] >>= 1;
+          if (ref_bit[s])
+            age[s] |= 0x80;
+          ref_bit[s] = 0;
+          if (age[s] < age[victim])
+            victim = s;
+        }
+      last_tick = ticks[i];
+      load (page, victim, ticks[i]);
+    }
+  return faults;
+}
+
+/* Exact least recently used. */
+static size_t
+sim_lru (int frames)
+{
+  struct plist lru;
+  size_t faults = 0, i;
+
+  plist_init (&lru, 0);
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+
+      if (list_of[page] == lru.id)
+        plist_remove (&lru, page);
+      else
+        {
+          faults++;
+          if (lru.cnt >= frames)
+            plist_pop (&lru);
+        }
+      plist_push (&lru, page);
+    }
+  return faults;
+}
+
+/* Full 2Q (Johnson and Shasha), with Kin = 25% and Kout = 50% of
+   memory. */
+static size_t
+sim_2q (int frames)
+{
+  struct plist a1in, am, a1out;
+  int kin = frames / 4, kout = frames / 2;
+  size_t faults = 0, i;
+
+  plist_init (&a1in, 0);
+  plist_init (&am, 1);
+  plist_init (&a1out, 2);
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+
+      if (list_of[page] == am.id)
+        {
+          plist_remove (&am, page);
+          plist_push (&am, page);
+          continue;
+        }
+      if (list_of[page] == a1in.id)
+        continue;
+
+      faults++;
+      if (a1in.cnt + am.cnt >= frames)
+        {
+          if (a1in.cnt > kin || am.cnt == 0)
+            {
+              plist_push (&a1out, plist_pop (&a1in));
+              if (a1out.cnt > kout)
+                plist_pop (&a1out);
+            }
+          else
+            plist_pop (&am);
+        }
+      if (list_of[page] == a1out.id)
+        {
+          plist_remove (&a1out, page);
+          plist_push (&am, page);
+        }
+      else
+        plist_push (&a1in, page);
+    }
+  return faults;
+}
+
+/* ARC's REPLACE: moves the oldest page of T1 or T2 to its ghost
+   list. */
+static void
+arc_replace (struct plist *t1, struct plist *t2, struct plist *b1,
+             struct plist *b2, int p, int page)
+{
+  if (t1->cnt > 0
+      && ((list_of[page] == b2->id && t1->cnt == p) || t1->cnt > p
+          || t2->cnt == 0))
+    plist_push (b1, plist_pop (t1));
+  else if (t2->cnt > 0)
+    plist_push (b2, plist_pop (t2));
+}
+
+/* Adaptive Replacement Cache (Megiddo and Modha). */
+static size_t
+sim_arc (int frames)
+{
+  struct plist t1, t2, b1, b2;
+  size_t faults = 0, i;
+  int p = 0;
+
+  plist_init (&t1, 0);
+  plist_init (&t2, 1);
+  plist_init (&b1, 2);
+  plist_init (&b2, 3);
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+
+      if (list_of[page] == t1.id || list_of[page] == t2.id)
+        {
+          plist_remove (list_of[page] == t1.id ? &t1 : &t2, page);
+          plist_push (&t2, page);
+          continue;
+        }
+
+      faults++;
+      if (list_of[page] == b1.id)
+        {
+          int delta = b2.cnt > b1.cnt ? b2.cnt / b1.cnt : 1;
+          p = p + delta < frames ? p + delta : frames;
+          arc_replace (&t1, &t2, &b1, &b2, p, page);
+          plist_remove (&b1, page);
+          plist_push (&t2, page);
+        }
+      else if (list_of[page] == b2.id)
+        {
+          int delta = b1.cnt > b2.cnt ? b1.cnt / b2.cnt : 1;
+          p = p > delta ? p - delta : 0;
+          arc_replace (&t1, &t2, &b1, &b2, p, page);
+          plist_remove (&b2, page);
+          plist_push (&t2, page);
+        }
+      else
+        {
+          if (t1.cnt + b1.cnt >= frames)
+            {
+              if (t1.cnt < frames)
+                {
+                  plist_pop (&b1);
+                  arc_replace (&t1, &t2, &b1, &b2, p, page);
+                }
+              else
+                plist_pop (&t1);
+            }
+          else if (t1.cnt + t2.cnt + b1.cnt + b2.cnt >= frames)
+            {
+              if (t1.cnt + t2.cnt + b1.cnt + b2.cnt >= 2 * frames)
+                plist_pop (&b2);
+              arc_replace (&t1, &t2, &b1, &b2, p, page);
+            }
+          plist_push (&t1, page);
+        }
+    }
+  return faults;
+}
+
+/* Belady's optimal policy: evicts the page whose next use is
+   furthest in the future. */
+static size_t
+sim_opt (int frames)
+{
+  size_t *next_use = malloc (ref_cnt * sizeof *next_use + 1);
+  size_t *upcoming = malloc (page_cnt * sizeof *upcoming + 1);
+  size_t faults = 0, i;
+  int used = 0;
+
+  if (next_use == NULL || upcoming == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+
+  /* next_use[i] is the index of the next reference to the page
+     referenced at i, or ref_cnt if there is none. */
+  for (i = 0; i < (size_t) page_cnt; i++)
+    upcoming[i] = ref_cnt;
+  for (i = ref_cnt; i-- > 0; )
+    {
+      next_use[i] = upcoming[refs[i]];
+      upcoming[refs[i]] = i;
+    }
+
+  /* last_use[] holds each frame's next use here. */
+  for (i = 0; i < ref_cnt; i++)
+    {
+      int page = refs[i];
+      int victim = 0, s;
+
+      if (slot_of[page] >= 0)
+        {
+          last_use[slot_of[page]] = next_use[i];
+          continue;
+        }
+      faults++;
+      if (used < frames)
+        victim = used++;
+      else
+        for (s = 1; s < frames; s++)
+          if (last_use[s] > last_use[victim])
+            victim = s;
+      load (page, victim, 0);
+      last_use[victim] = next_use[i];
+    }
+
+  free (next_use);
+  free (upcoming);
+  return faults;
+}
+
+static void
+plist_init (struct plist *l, int id)
+{
+  l->id = id;
+  l->head = l->tail = -1;
+  l->cnt = 0;
+}
+
+/* Appends PAGE to L as the newest page. */
+static void
+plist_push (struct plist *l, int page)
+{
+  prev[page] = l->tail;
+  next[page] = -1;
+  if (l->tail >= 0)
+    next[l->tail] = page;
+  else
+    l->head = page;
+  l->tail = page;
+  list_of[page] = l->id;
+  l->cnt++;
+}
+
+/* Removes and returns the oldest page in L, which must not be
+   empty. */
+static int
+plist_pop (struct plist *l)
+{
+  int page = l->head;
+
+  plist_remove (l, page);
+  return page;
+}
+
+/* Removes PAGE from L. */
+static void
+plist_remove (struct plist *l, int page)
+{
+  if (prev[page] >= 0)
+    next[prev[page]] = next[page];
+  else
+    l->head = next[page];
+  if (next[page] >= 0)
+    prev[next[page]] = prev[page];
+  else
+    l->tail = prev[page];
+  list_of[page] = -1;
+  l->cnt--;
+}
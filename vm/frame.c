@@ -1,75 +1,174 @@
-/*
- * vm.c
- *
- *  Created on: Jun 2, 2013
- *      Author: jb
- */
+#include <debug.h>
 #include <stdio.h>
-#include "kernel/list.h"
-#include "threads/synch.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
-#include "frame.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/pageout.h"
+#include "vm/vm.h"
+
+/*
+ * Frame table, indexed by physical page number.
+ * Either pool may own any page after palloc lends ranges around,
+ * so the table covers all of RAM.  Entries are protected by
+ * page_lock in vm/page.c.
+ */
+struct frame *frame_table;
+size_t frame_cnt;
 
 /*
- * Page directory list initialization.
- * Call from main()->ram_init() in init.c.
+ * Frame table initialization.
+ * Call from main() in init.c, after palloc_init() and malloc_init().
  */
 void
 frame_init (void)
 {
-	list_init(&pagedir_list);
-	lock_init(&pagedir_list_lock);
-	printf("Page Directory List initializing...\n");
+	frame_cnt = ram_pages;
+	frame_table = calloc(frame_cnt, sizeof *frame_table);
+	if (frame_table == NULL)
+		PANIC("Not enough memory for frame table.");
+	printf("Frame table initializing...\n");
+	vm_init();
 	return;
 }
 
 /*
- * Add a page directory to the list.
- * Marks pointer of owning thread and its page directory ptr.
+ * Allocate a user frame to hold page P.  Eviction is normally
+ * left to the page-out daemon, which is woken here once the
+ * user pool runs low; only below the minimum watermark does
+ * the caller evict a page itself.  A process at its resident
+ * set limit first gives up one of its own pages, so that it
+ * cannot push other processes out.  The frame is returned pinned;
+ * unpin it once P is mapped.  Returns NULL if nothing can be
+ * evicted.  Call with page_lock held.
  */
-void
-add_pagedir(struct thread *t)
+void *
+frame_alloc(struct page *p)
 {
-	struct pagedir_list_entry *ple = (struct pagedir_list_entry*)malloc(sizeof(struct pagedir_list_entry));
-	if (ple == NULL)
-		return;
+	struct frame *victim;
+	void *kpage = NULL;
 
-	ple->pagedir.owner = t;
-	ple->pagedir.pagedir_ptr = t->pagedir;
+	if (page_over_limit(p->owner)
+	    && (victim = select_victim_local(p->owner)) != NULL
+	    && page_out(victim->page))
+		thread_current()->evictions++;
 
-	list_push_back(&pagedir_list, &ple->elem);
+	pageout_kick();
+	while (palloc_free_cnt(PAL_USER) < pageout_min
+	       || (kpage = palloc_get_page(PAL_USER)) == NULL)
+	{
+		victim = select_victim_page();
+		if (victim != NULL && page_out(victim->page))
+		{
+			thread_current()->evictions++;
+			continue;
+		}
+		/* Dip into the reserve, or wait for pages in flight. */
+		if ((kpage = palloc_get_page(PAL_USER)) != NULL)
+			break;
+		if (!page_wait_evicting())
+			return NULL;
+	}
 
-	return;
+	frame_set_page(kpage, p);
+	vm_frame_added(frame_lookup(kpage));
+	frame_pin(kpage);
+	return kpage;
 }
 
 /*
- * Remove page directory entry from list.
+ * Empty the PAGE_CNT frames starting at PAGES, which palloc is
+ * taking back for the kernel pool, by moving or dropping their
+ * pages with page_migrate().  Frames that are pinned, or dirty
+ * with no free frame to move to, are left alone; they reach the
+ * kernel pool whenever they are freed later.  Called from
+ * palloc_get_multiple().  Does nothing if our caller holds
+ * page_lock, since it may be in the middle of using one of these
+ * frames; the page-out daemon frees them in time instead.
+ * Otherwise only tries the lock rather than wait for it: a thread
+ * holding page_lock may be blocked on a lock that our caller
+ * holds, such as malloc()'s.  Returns the number of frames freed.
+ */
+size_t
+frame_evacuate(void *pages, size_t page_cnt)
+{
+	size_t freed = 0;
+	size_t i;
+
+	if (lock_held_by_current_thread(&page_lock)
+	    || !lock_try_acquire(&page_lock))
+		return 0;
+	for (i = 0; i < page_cnt; i++)
+		if (page_migrate((uint8_t *) pages + i * PGSIZE))
+			freed++;
+	pageout_kick();
+	lock_release(&page_lock);
+	return freed;
+}
+
+/*
+ * Record that user frame KPAGE holds page P.
  */
 void
-remove_pagedir(struct thread *t)
+frame_set_page(void *kpage, struct page *p)
 {
-	struct pagedir_list_entry *ple = search_pagedir(t);
-	free(ple);
+	frame_lookup(kpage)->page = p;
+}
 
-	return;
+/*
+ * Release user frame KPAGE back to the user pool.
+ */
+void
+frame_free(void *kpage)
+{
+	struct frame *f = frame_lookup(kpage);
+
+	vm_frame_removed(f);
+	f->page = NULL;
+	f->pin_cnt = 0;
+	f->cksum = 0;
+	palloc_free_page(kpage);
 }
 
 /*
- * Find entry of page directory list and return its pointer.
- * If it not exist, return NULL.
+ * Find the frame table entry of KPAGE.
  */
-struct pagedir_list_entry*
-search_pagedir(struct thread *t)
+struct frame *
+frame_lookup(void *kpage)
 {
-	struct pagedir_list_entry *ple;
-	struct list_elem *e;
+	size_t idx = vtop(kpage) >> PGBITS;
 
-	for (e = list_begin(&pagedir_list); e != list_end(&pagedir_list); e = list_next(e))
-	{
-		ple = list_entry(e, struct pagedir_list_entry, elem);
-		if (ple == t->pagedir){
-			return ple;
-		}
-	}
-	return NULL;
+	ASSERT(idx < frame_cnt);
+	return &frame_table[idx];
+}
+
+/*
+ * Return the kernel virtual address of frame F.
+ */
+void *
+frame_kpage(struct frame *f)
+{
+	return ptov((uintptr_t) (f - frame_table) << PGBITS);
+}
+
+/*
+ * Pin and unpin a frame.  A pinned frame is never chosen as a
+ * victim, e.g. while a system call is reading into it.  Pins
+ * nest, since processes sharing a frame may pin it at once.
+ */
+void
+frame_pin(void *kpage)
+{
+	frame_lookup(kpage)->pin_cnt++;
+}
+
+void
+frame_unpin(void *kpage)
+{
+	struct frame *f = frame_lookup(kpage);
+
+	ASSERT(f->pin_cnt > 0);
+	f->pin_cnt--;
 }
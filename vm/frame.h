@@ -1,35 +1,41 @@
-/*
- * vm.h
- *
- *  Created on: Jun 2, 2013
- *      Author: jb
- */
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
-#include "kernel/list.h"
-#include "kernel/hash.h"
-#include "threads/thread.h"
-#include "threads/malloc.h"
-#include <stdio.h>
-
-struct list pagedir_list;
-struct lock pagedir_list_lock;
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vm/page.h"
 
-void frame_init (void);
-void add_pagedir(struct thread*);
-void remove_pagedir(struct thread*);
-struct pagedir_list_entry* search_pagedir(struct thread *);
-
-struct page_id
+/*
+ * Frame table entry.
+ * There is one per physical page; only frames handed out by
+ * frame_alloc() have pages.  After fork() several processes'
+ * pages may share a frame copy-on-write; they are chained
+ * through struct page's frame_next member.
+ */
+struct frame
 {
-  struct thread* owner;
-  uint32_t *pagedir_ptr;
-};
+	struct page *page;	/* First page held in this frame (reverse map). */
+	unsigned pin_cnt;	/* Exempt from eviction while nonzero. */
+	unsigned cksum;		/* Contents at the last KSM scan. */
 
-struct pagedir_list_entry
-{
-	struct list_elem elem;
-	struct page_id pagedir;
-	struct lock modify_lock;
+	/* Replacement policy state, see vm/vm.c. */
+	struct list_elem elem;	/* Element in a replacement queue. */
+	int queue;		/* Queue ELEM is in, enum vm_queue. */
+	uint8_t age;		/* Aging: accessed bit history. */
+	int64_t last_use;	/* WSClock: ticks when last seen accessed. */
 };
+
+extern struct frame *frame_table;
+extern size_t frame_cnt;
+
+void frame_init (void);
+void *frame_alloc (struct page *);
+void frame_set_page (void *kpage, struct page *);
+void frame_free (void *kpage);
+size_t frame_evacuate (void *pages, size_t page_cnt);
+struct frame *frame_lookup (void *kpage);
+void *frame_kpage (struct frame *);
+void frame_pin (void *kpage);
+void frame_unpin (void *kpage);
 #endif
@@ -0,0 +1,189 @@
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Same-page merging.  A kernel thread walks the frame table,
+   ksm_rate frames every KSM_INTERVAL ticks, looking for user
+   frames with the same contents.  A frame is only considered
+   once its checksum is unchanged since the previous pass, so
+   pages that are being written are left alone.  Stable frames
+   are entered in a table keyed by checksum; a frame that matches
+   an earlier one is merged into it by page_merge(), and all-zero
+   frames are replaced by the shared zero page.  Merged pages are
+   read-only, and a write fault splits them again like any other
+   copy-on-write page.
+
+   The table is emptied at the start of every pass, since its
+   frames may have been written, evicted or freed since they
+   were entered.  page_mergeable() and page_merge() check them
+   again before use. */
+unsigned ksm_rate;
+
+/* Ticks between scans. */
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+
+/* A stable frame, by checksum. */
+struct ksm_node
+  {
+    struct hash_elem elem;
+    unsigned cksum;
+    void *kpage;
+  };
+
+static struct hash stable;
+static size_t ksm_hand;         /* Next frame to examine. */
+static unsigned zero_cksum;     /* Checksum of a page of zeros. */
+
+/* Statistics. */
+static unsigned ksm_passes, ksm_scanned;
+static unsigned ksm_merged, ksm_zeroed;
+
+static thread_func ksm_daemon NO_RETURN;
+static void ksm_scan (struct frame *);
+static unsigned ksm_hash (const struct hash_elem *, void *);
+static bool ksm_less (const struct hash_elem *, const struct hash_elem *,
+                      void *);
+static void ksm_free (struct hash_elem *, void *);
+
+/* Starts the scanner if it was enabled with -ksm.  Call after
+   thread_start(). */
+void
+ksm_init (void)
+{
+  void *zeros;
+
+  if (ksm_rate == 0)
+    return;
+
+  zeros = palloc_get_page (PAL_ZERO);
+  if (zeros == NULL || !hash_init (&stable, ksm_hash, ksm_less, NULL))
+    PANIC ("ksm_init: out of memory");
+  zero_cksum = hash_bytes (zeros, PGSIZE);
+  palloc_free_page (zeros);
+  thread_create ("ksm", PRI_DEFAULT, ksm_daemon, NULL);
+}
+
+/* Prints same-page merging statistics. */
+void
+ksm_print_stats (void)
+{
+  if (ksm_rate != 0)
+    printf ("KSM: %u passes, %u frames scanned, "
+            "%u pages merged, %u zeroed\n",
+            ksm_passes, ksm_scanned, ksm_merged, ksm_zeroed);
+}
+
+/* Scanner thread. */
+static void
+ksm_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      unsigned i;
+
+      for (i = 0; i < ksm_rate; i++)
+        {
+          if (ksm_hand == 0)
+            {
+              hash_clear (&stable, ksm_free);
+              ksm_passes++;
+            }
+
+          /* page_lock is taken per frame, so faults are not held
+             up for a whole batch. */
+          lock_acquire (&page_lock);
+          ksm_scan (&frame_table[ksm_hand]);
+          lock_release (&page_lock);
+          if (++ksm_hand >= frame_cnt)
+            ksm_hand = 0;
+        }
+      timer_sleep (KSM_INTERVAL);
+    }
+}
+
+/* Examines frame F, merging it with an earlier frame of the same
+   contents if there is one.  The caller must hold page_lock. */
+static void
+ksm_scan (struct frame *f)
+{
+  void *kpage = frame_kpage (f);
+  struct ksm_node key, *node;
+  struct hash_elem *e;
+  unsigned cksum;
+
+  if (!page_mergeable (kpage))
+    return;
+  ksm_scanned++;
+
+  /* Leave frames alone until they stop changing. */
+  cksum = hash_bytes (kpage, PGSIZE);
+  if (cksum != f->cksum)
+    {
+      f->cksum = cksum;
+      return;
+    }
+
+  if (cksum == zero_cksum && page_merge_zero (kpage))
+    {
+      ksm_zeroed++;
+      return;
+    }
+
+  key.cksum = cksum;
+  e = hash_find (&stable, &key.elem);
+  if (e != NULL)
+    {
+      node = hash_entry (e, struct ksm_node, elem);
+      if (node->kpage != kpage && page_mergeable (node->kpage)
+          && frame_lookup (node->kpage)->cksum == cksum
+          && page_merge (node->kpage, kpage))
+        {
+          ksm_merged++;
+          return;
+        }
+
+      /* Stale, or a checksum collision: F takes its place. */
+      node->kpage = kpage;
+      return;
+    }
+
+  node = malloc (sizeof *node);
+  if (node != NULL)
+    {
+      node->cksum = cksum;
+      node->kpage = kpage;
+      hash_insert (&stable, &node->elem);
+    }
+}
+
+/* Hash function for the stable table. */
+static unsigned
+ksm_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct ksm_node, elem)->cksum;
+}
+
+/* Orders stable table entries by checksum. */
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return (hash_entry (a, struct ksm_node, elem)->cksum
+          < hash_entry (b, struct ksm_node, elem)->cksum);
+}
+
+/* Frees a stable table entry. */
+static void
+ksm_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct ksm_node, elem));
+}
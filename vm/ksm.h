@@ -0,0 +1,10 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+/* Frames examined per scan interval, or 0 if disabled. */
+extern unsigned ksm_rate;
+
+void ksm_init (void);
+void ksm_print_stats (void);
+
+#endif /* vm/ksm.h */
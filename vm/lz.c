@@ -0,0 +1,123 @@
+#include "vm/lz.h"
+#include <stdint.h>
+#include <string.h>
+
+/* A small LZ77 codec in the style of LZRW1, fast enough to run
+   on every page evicted to the compressed swap cache.
+
+   The output is a series of groups, each a control byte followed
+   by up to 8 items, one per control bit from the least
+   significant up.  A clear bit is a literal byte.  A set bit is
+   a two-byte match: a 12-bit backward OFFSET (1 to 4095) and a
+   4-bit LENGTH - 3 (3 to 18 bytes), copied from earlier output,
+   possibly overlapping it.  Candidate matches are found through
+   a hash of the next 3 bytes, remembering only the last position
+   with each hash. */
+
+#define HASH_BITS 12
+#define MIN_MATCH 3
+#define MAX_MATCH (MIN_MATCH + 15)
+#define MAX_OFFSET 4095
+
+/* Last position + 1 with each hash, 0 if none.  Callers
+   serialize compression, so one table suffices. */
+static uint16_t hash_table[1 << HASH_BITS];
+
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  return ((((unsigned) p[0] << 8) ^ ((unsigned) p[1] << 4) ^ p[2])
+          * 40543u >> 4) & ((1 << HASH_BITS) - 1);
+}
+
+/* Compresses SRC_LEN bytes from SRC, at most 65535, into DST.
+   Returns the compressed size, or 0 if it would exceed DST_SIZE
+   bytes.  Not reentrant. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_, *p = src_, *end = src + src_len;
+  uint8_t *dst = dst_, *o = dst_, *o_end = dst + dst_size;
+
+  memset (hash_table, 0, sizeof hash_table);
+  while (p < end)
+    {
+      uint8_t *ctrl;
+      int bit;
+
+      /* Worst case for a group: 8 matches. */
+      if (o_end - o < 1 + 8 * 2)
+        return 0;
+      ctrl = o++;
+      *ctrl = 0;
+      for (bit = 0; bit < 8 && p < end; bit++)
+        {
+          if (end - p >= MIN_MATCH)
+            {
+              unsigned h = hash3 (p);
+              unsigned cand = hash_table[h];
+              const uint8_t *q = src + cand - 1;
+
+              hash_table[h] = p - src + 1;
+              if (cand != 0 && (size_t) (p - q) <= MAX_OFFSET
+                  && q[0] == p[0] && q[1] == p[1] && q[2] == p[2])
+                {
+                  size_t ofs = p - q;
+                  size_t n = MIN_MATCH;
+
+                  while (n < MAX_MATCH && p + n < end && q[n] == p[n])
+                    n++;
+                  *o++ = ofs >> 4;
+                  *o++ = ((ofs & 0xf) << 4) | (n - MIN_MATCH);
+                  *ctrl |= 1 << bit;
+                  p += n;
+                  continue;
+                }
+            }
+          *o++ = *p++;
+        }
+    }
+  return o - dst;
+}
+
+/* Decompresses SRC_LEN bytes from SRC into exactly DST_LEN bytes
+   at DST.  Returns false if SRC is malformed. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *s = src_, *s_end = s + src_len;
+  uint8_t *dst = dst_, *o = dst_, *o_end = dst + dst_len;
+
+  while (o < o_end)
+    {
+      unsigned ctrl;
+      int bit;
+
+      if (s >= s_end)
+        return false;
+      ctrl = *s++;
+      for (bit = 0; bit < 8 && o < o_end; bit++)
+        if (ctrl & (1 << bit))
+          {
+            size_t ofs, n;
+
+            if (s_end - s < 2)
+              return false;
+            ofs = ((size_t) s[0] << 4) | (s[1] >> 4);
+            n = (s[1] & 0xf) + MIN_MATCH;
+            s += 2;
+            if (ofs == 0 || ofs > (size_t) (o - dst)
+                || n > (size_t) (o_end - o))
+              return false;
+            for (; n > 0; n--, o++)
+              *o = o[-ofs];
+          }
+        else
+          {
+            if (s >= s_end)
+              return false;
+            *o++ = *s++;
+          }
+    }
+  return true;
+}
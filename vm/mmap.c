@@ -0,0 +1,116 @@
+#include "vm/mmap.h"
+#include <list.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* A memory-mapped file.  Its pages are ordinary page table
+   entries marked mapped, so they are faulted in lazily and
+   written back to the file, not to swap, when evicted dirty. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's mappings. */
+    mapid_t id;
+    struct file *file;          /* Private reopening of the file. */
+    uint8_t *base;              /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+  };
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process starting at ADDR, which
+   must be page-aligned and nonzero.  The mapping uses its own
+   reopening of FILE, so it is unaffected by FILE being closed or
+   removed.  Returns the new mapping's id, or MAP_FAILED if FILE
+   is empty or the range is not free user memory. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length == 0 || !is_user_vaddr ((uint8_t *) addr + length - 1))
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->base = addr;
+  m->page_cnt = 0;
+  for (i = 0; i * PGSIZE < (size_t) length; i++)
+    {
+      size_t left = length - i * PGSIZE;
+      size_t read_bytes = left < PGSIZE ? left : PGSIZE;
+
+      if (!page_add_mapped (m->base + i * PGSIZE, m->file, i * PGSIZE,
+                            read_bytes))
+        {
+          unmap (m);
+          return MAP_FAILED;
+        }
+      m->page_cnt++;
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Removes mapping ID of the current process, writing modified
+   pages back to the file.  Does nothing if there is no such
+   mapping. */
+void
+mmap_unmap (mapid_t id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Removes all of the current process's mappings, at exit. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Writes back and removes the pages of M, closes its file and
+   frees it.  M must not be in a mappings list. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
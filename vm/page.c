@@ -0,0 +1,1375 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/pageout.h"
+#include "vm/swap.h"
+#include "vm/text.h"
+#include "vm/trace.h"
+#include "vm/vm.h"
+
+/* Serializes page faults, eviction and page table teardown.
+   Eviction touches other processes' page tables, so a single
+   lock keeps the owner from changing or freeing an entry while
+   it is being evicted.  The lock is dropped while a page is
+   written to swap; the page is PAGE_EVICTING meanwhile and
+   anyone who needs it waits on evict_done. */
+struct lock page_lock;
+static struct condition evict_done;
+static unsigned evicting_cnt;   /* Frames being written to swap. */
+
+/* Swap readahead window limits, in pages including the faulting
+   page.  The window doubles while most read-ahead pages get used
+   and halves while most are wasted. */
+#define RA_MIN 2
+#define RA_INIT 4
+#define RA_MAX 16
+
+/* Resident set limit per process, in pages, or 0 for none.  Set
+   with -rsslimit.  A process at its limit replaces its own pages
+   rather than take frames from others. */
+size_t page_rss_limit;
+
+/* Page-fault-frequency working set sizing.  Faults are counted
+   per process over windows of PFF_WINDOW ticks.  A process that
+   takes more than PFF_HIGH faults in a window has its resident
+   set target raised by the excess; one that takes fewer than
+   PFF_LOW has it lowered by a quarter per quiet window.  When
+   frames run short, select_victim_page() takes them from
+   processes above their target first. */
+#define PFF_WINDOW (TIMER_FREQ / 10)
+#define PFF_HIGH 16
+#define PFF_LOW 2
+#define PFF_MIN_TARGET 16
+#define PFF_INIT_TARGET 64
+
+/* Number of processes with more pages resident than their
+   target. */
+unsigned page_over_target_cnt;
+
+/* Stack region.  Each process's stack is the pages from its
+   stack_bottom up to PHYS_BASE, and may grow down to
+   page_stack_limit pages, set with -stacklimit.  An access at
+   most STACK_SLOP bytes below the stack pointer, the 32 bytes
+   that PUSHA writes, grows it.  Growth that continues right below
+   the current bottom doubles the number of pages read in ahead of
+   the fault, up to STACK_BATCH_MAX; any other growth starts over
+   at one page. */
+#define STACK_SLOP 32
+#define STACK_BATCH_MAX 16
+size_t page_stack_limit = 2048;
+
+/* Zero-filled page mapped read-only by all untouched anonymous
+   pages that have been read, until they are written. */
+static void *zero_kpage;
+
+/* Statistics. */
+static unsigned ra_pages, ra_hits;      /* Swap readahead. */
+static unsigned clean_drops;            /* Evictions without a write. */
+static unsigned zero_maps;              /* Read faults on the zero page. */
+static unsigned cow_copies, cow_reuses; /* Copy-on-write faults. */
+static unsigned mapped_writes;          /* mmap pages written back. */
+static unsigned target_grows, target_shrinks; /* Working set targets. */
+static unsigned advised_in, advised_out; /* WILLNEED, DONTNEED pages. */
+static unsigned stack_grows, stack_prefaults; /* Stack growth. */
+static unsigned migrations;             /* Frames moved by page_migrate(). */
+
+/* Pages locked with MADV_LOCK, and the most allowed: half of the
+   user pool, so that the rest of the system can still run. */
+static size_t locked_cnt, locked_max;
+
+static unsigned page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+                       void *);
+static void page_destroy (struct hash_elem *, void *);
+static struct page *page_add (void *upage, bool writable);
+static bool page_load (struct page *);
+static void page_free_frame (struct page *, void *kpage);
+static bool page_unshare (struct page *);
+static void page_unlink (struct page *);
+static void page_drop (struct page *);
+static void page_protect (void *kpage, bool writable);
+static void page_readahead (struct page *, size_t slot);
+static size_t page_swap_hint (struct page *);
+static void page_set_location (struct page *, enum page_location);
+static void page_set_rss (struct thread *, size_t rss, size_t target);
+static void page_count_fault (struct thread *);
+
+/* Initializes the page module.  Call once at boot. */
+void
+page_init (void)
+{
+  lock_init (&page_lock);
+  cond_init (&evict_done);
+  text_init ();
+  zero_kpage = palloc_get_page (PAL_ZERO);
+  if (zero_kpage == NULL)
+    PANIC ("page_init: out of memory");
+  locked_max = palloc_free_cnt (PAL_USER) / 2;
+}
+
+/* Creates an empty page table for the current process.
+   Returns true if successful, false on allocation failure. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  t->ra_window = RA_INIT;
+  t->ra_cnt = 0;
+  t->rss = 0;
+  t->rss_target = PFF_INIT_TARGET;
+  if (page_rss_limit != 0 && t->rss_target > page_rss_limit)
+    t->rss_target = page_rss_limit;
+  t->pff_start = timer_ticks ();
+  t->pff_faults = 0;
+  t->stack_bottom = PHYS_BASE;
+  t->stack_batch = 1;
+  return hash_init (&t->pages, page_hash, page_less, NULL);
+}
+
+/* Destroys the current process's page table, releasing the
+   frames and swap slots it holds.  Must be called while the
+   process's page directory is still in place. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&page_lock);
+  hash_destroy (&t->pages, page_destroy);
+  lock_release (&page_lock);
+}
+
+/* Returns the page table entry of T that contains VADDR, or a
+   null pointer if there is none. */
+struct page *
+page_lookup (struct thread *t, const void *vaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (vaddr);
+  e = hash_find (&t->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Adds a page at UPAGE to the current process that reads as all
+   zeros on first touch.  Returns true if successful, false if
+   UPAGE is already in use or on allocation failure. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  bool success;
+
+  lock_acquire (&page_lock);
+  success = page_add (upage, writable) != NULL;
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Adds a page at UPAGE to the current process whose first
+   READ_BYTES bytes are read from FILE at offset OFS on first
+   touch, with the rest of the page zeroed.  Returns true if
+   successful, false if UPAGE is already in use or on allocation
+   failure. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  lock_acquire (&page_lock);
+  p = page_add (upage, writable);
+  if (p != NULL)
+  {
+    p->location = PAGE_FILE;
+    p->file = file;
+    p->file_ofs = ofs;
+    p->read_bytes = read_bytes;
+  }
+  lock_release (&page_lock);
+  return p != NULL;
+}
+
+/* Adds a page at UPAGE to the current process that maps the
+   READ_BYTES bytes of FILE at offset OFS, with the rest of the
+   page zeroed, for mmap().  Unlike page_add_file(), changes are
+   written back to FILE rather than to swap.  Returns true if
+   successful, false if UPAGE is already in use or on allocation
+   failure. */
+bool
+page_add_mapped (void *upage, struct file *file, off_t ofs,
+                 size_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  lock_acquire (&page_lock);
+  p = page_add (upage, true);
+  if (p != NULL)
+  {
+    p->location = PAGE_FILE;
+    p->file = file;
+    p->file_ofs = ofs;
+    p->read_bytes = read_bytes;
+    p->mapped = true;
+  }
+  lock_release (&page_lock);
+  return p != NULL;
+}
+
+/* Removes UPAGE from the current process's page table, writing
+   it back to its file first if it is a modified mmap page. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  lock_acquire (&page_lock);
+  p = page_lookup (t, upage);
+  if (p != NULL)
+  {
+    while (p->location == PAGE_EVICTING)
+      cond_wait (&evict_done, &page_lock);
+    if (p->location == PAGE_FRAME && p->mapped
+        && pagedir_is_dirty (t->pagedir, p->upage))
+    {
+      file_write_at (p->file, p->kpage, p->read_bytes, p->file_ofs);
+      mapped_writes++;
+    }
+    hash_delete (&t->pages, &p->elem);
+    page_destroy (&p->elem, NULL);
+  }
+  lock_release (&page_lock);
+}
+
+/* Brings the page containing FAULT_ADDR into a frame and maps it
+   in the current process.  WRITE tells whether the faulting
+   access was a write.  A read of an untouched zero page just maps
+   the shared zero page, read-only; the write fault that follows
+   gets the page its own frame.  A write fault on a frame shared
+   copy-on-write gives the page a private copy.  Stores the kind
+   of fault in *TYPE.  Returns true if successful,
+   false if the address is not in the page table, the access is
+   not allowed, or on I/O failure. */
+bool
+page_in (void *fault_addr, bool write, enum fault_type *type)
+{
+  struct page *p;
+  bool from_swap;
+  size_t slot;
+  bool success;
+
+  lock_acquire (&page_lock);
+  p = page_lookup (thread_current (), fault_addr);
+  if (p == NULL)
+  {
+    lock_release (&page_lock);
+    return false;
+  }
+  while (p->location == PAGE_EVICTING)
+    cond_wait (&evict_done, &page_lock);
+  if (write && !p->writable)
+  {
+    lock_release (&page_lock);
+    return false;
+  }
+  if (p->location == PAGE_FRAME)
+  {
+    *type = FAULT_COW;
+    success = write && page_unshare (p);
+    if (success)
+      frame_unpin (p->kpage);
+    lock_release (&page_lock);
+    return success;
+  }
+  if (p->location == PAGE_ZERO && !write)
+  {
+    *type = FAULT_ZERO;
+    success = pagedir_set_page (p->owner->pagedir, p->upage, zero_kpage,
+                                false);
+    if (success)
+    {
+      p->location = PAGE_ZERO_MAPPED;
+      zero_maps++;
+    }
+    lock_release (&page_lock);
+    return success;
+  }
+  from_swap = p->location == PAGE_SWAP;
+  if (from_swap)
+    *type = FAULT_SWAP;
+  else if (p->location == PAGE_FILE)
+    *type = FAULT_FILE;
+  else
+    *type = FAULT_ZERO;
+  slot = p->swap_slot;
+  trace_fault (p->upage, p->owner->tid);
+  page_count_fault (p->owner);
+  success = page_load (p);
+  if (success)
+  {
+    frame_unpin (p->kpage);
+    if (from_swap)
+      page_readahead (p, slot);
+  }
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Grows the current process's stack down to the page containing
+   FAULT_ADDR, given stack pointer ESP, adding zero pages for any
+   pages skipped over.  On repeated growth also reads in the next
+   pages below, so that a deep recursion does not trap on every
+   page.  The faulting page itself is left for page_in().  Returns
+   true if successful, false if FAULT_ADDR is not a stack access,
+   is beyond the stack limit, or runs into another region. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = pg_round_down (fault_addr);
+  uint8_t *limit = (uint8_t *) PHYS_BASE - page_stack_limit * PGSIZE;
+  uint8_t *first, *bottom;
+  bool success;
+
+  if ((const uint8_t *) fault_addr < (const uint8_t *) esp - STACK_SLOP
+      || upage < limit || upage >= t->stack_bottom)
+    return false;
+
+  if (upage == t->stack_bottom - PGSIZE && t->stack_bottom != PHYS_BASE)
+    t->stack_batch = t->stack_batch * 2 < STACK_BATCH_MAX
+                     ? t->stack_batch * 2 : STACK_BATCH_MAX;
+  else
+    t->stack_batch = 1;
+  first = upage - (t->stack_batch - 1) * PGSIZE;
+  if (first < limit)
+    first = limit;
+
+  lock_acquire (&page_lock);
+  for (bottom = t->stack_bottom - PGSIZE; bottom >= first; bottom -= PGSIZE)
+  {
+    if (page_add (bottom, true) == NULL)
+      break;
+    t->stack_bottom = bottom;
+  }
+  success = t->stack_bottom <= upage;
+  if (success)
+    stack_grows++;
+
+  /* Read in the pages below the fault, stopping rather than
+     evict. */
+  for (bottom = upage - PGSIZE; success && bottom >= t->stack_bottom;
+       bottom -= PGSIZE)
+  {
+    struct page *p = page_lookup (t, bottom);
+
+    if (palloc_free_cnt (PAL_USER) < pageout_low || !page_load (p))
+      break;
+    frame_unpin (p->kpage);
+    stack_prefaults++;
+  }
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Evicts the frame of page P, along with every other page sharing
+   it, and frees the frame.  A frame that is clean since it was
+   loaded is simply dropped: its pages revert to their swap copy
+   if they have one, else to their file or to zeros.  A dirty
+   frame is written to swap, reusing the pages' old slot if no
+   other page refers to it, or back to its file for an mmap page.
+   The caller must hold page_lock, which is released during the
+   disk write.  Returns true if successful, false if swap is
+   full. */
+bool
+page_out (struct page *p)
+{
+  void *kpage = p->kpage;
+  struct page *head = frame_lookup (kpage)->page;
+  struct page *q, *next;
+  size_t sharers = 0;
+  bool dirty = false;
+  size_t slot;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+  ASSERT (p->location == PAGE_FRAME);
+
+  /* Sharers all have the same swap slot, if any. */
+  for (q = head; q != NULL; q = q->frame_next)
+  {
+    dirty = dirty || pagedir_is_dirty (q->owner->pagedir, q->upage);
+    sharers++;
+  }
+
+  if (!dirty)
+  {
+    for (q = head; q != NULL; q = next)
+    {
+      next = q->frame_next;
+      pagedir_clear_page (q->owner->pagedir, q->upage);
+      q->kpage = NULL;
+      q->frame_next = NULL;
+      if (q->swap_slot != SWAP_ERROR)
+        page_set_location (q, PAGE_SWAP);
+      else
+        page_set_location (q, q->file != NULL ? PAGE_FILE : PAGE_ZERO);
+    }
+    vm_frame_evicted (frame_lookup (kpage));
+    page_free_frame (head, kpage);
+    clean_drops++;
+    return true;
+  }
+
+  /* mmap pages go back to their file, and are never shared. */
+  slot = head->swap_slot;
+  if (head->mapped)
+  {
+    ASSERT (sharers == 1);
+  }
+  else if (slot == SWAP_ERROR || swap_ref_cnt (slot) != sharers)
+  {
+    slot = swap_alloc (page_swap_hint (head));
+    if (slot == SWAP_ERROR)
+      return false;
+    for (q = head; q != NULL; q = q->frame_next)
+    {
+      if (q->swap_slot != SWAP_ERROR)
+        swap_release (q->swap_slot);
+      if (q != head)
+        swap_share (slot);
+      q->swap_slot = slot;
+    }
+  }
+
+  /* Unmap first, so the owners cannot change the page under the
+     write, and pin the frame so nobody else picks it. */
+  for (q = head; q != NULL; q = q->frame_next)
+  {
+    pagedir_clear_page (q->owner->pagedir, q->upage);
+    page_set_location (q, PAGE_EVICTING);
+  }
+  frame_pin (kpage);
+  evicting_cnt++;
+
+  lock_release (&page_lock);
+  if (head->mapped)
+  {
+    file_write_at (head->file, kpage, head->read_bytes, head->file_ofs);
+    mapped_writes++;
+  }
+  else
+    swap_swap_out (slot, kpage);
+  lock_acquire (&page_lock);
+
+  evicting_cnt--;
+  for (q = head; q != NULL; q = next)
+  {
+    next = q->frame_next;
+    q->location = q->mapped ? PAGE_FILE : PAGE_SWAP;
+    q->kpage = NULL;
+    q->frame_next = NULL;
+  }
+  vm_frame_evicted (frame_lookup (kpage));
+  page_free_frame (head, kpage);
+  cond_broadcast (&evict_done, &page_lock);
+  return true;
+}
+
+/* If any page is being written to swap, waits until one is done
+   and returns true.  Returns false at once otherwise.  The
+   caller must hold page_lock. */
+bool
+page_wait_evicting (void)
+{
+  ASSERT (lock_held_by_current_thread (&page_lock));
+
+  if (evicting_cnt == 0)
+    return false;
+  cond_wait (&evict_done, &page_lock);
+  return true;
+}
+
+/* Returns true if process T has as many pages resident as the
+   -rsslimit option allows. */
+bool
+page_over_limit (struct thread *t)
+{
+  return page_rss_limit != 0 && t->rss >= page_rss_limit;
+}
+
+/* Makes every page in the SIZE bytes of user memory starting at
+   UADDR resident in the current process and pins its frame, so
+   that a system call can access it without faulting.  If WRITE
+   is true the pages are also made writable, copying frames that
+   are shared copy-on-write.  Returns true if successful, false if
+   any page is not part of the address space or not writable, in
+   which case nothing is left pinned. */
+bool
+page_pin (const void *uaddr, size_t size, bool write)
+{
+  struct thread *t = thread_current ();
+  const uint8_t *first = pg_round_down (uaddr);
+  const uint8_t *last = pg_round_down ((const uint8_t *) uaddr
+                                       + (size > 0 ? size - 1 : 0));
+  const uint8_t *upage;
+
+  lock_acquire (&page_lock);
+  for (upage = first; upage <= last; upage += PGSIZE)
+  {
+    struct page *p = is_user_vaddr (upage) ? page_lookup (t, upage) : NULL;
+    bool success;
+
+    /* page_load() and page_unshare() leave the frame pinned. */
+    if (p == NULL || (write && !p->writable))
+      success = false;
+    else if (p->location != PAGE_FRAME)
+    {
+      trace_fault (p->upage, t->tid);
+      success = page_load (p);
+    }
+    else if (write)
+      success = page_unshare (p);
+    else
+    {
+      frame_pin (p->kpage);
+      success = true;
+    }
+    if (!success)
+    {
+      lock_release (&page_lock);
+      if (upage > first)
+        page_unpin (first, upage - first);
+      return false;
+    }
+  }
+  lock_release (&page_lock);
+  return true;
+}
+
+/* Unpins the frames pinned by page_pin (UADDR, SIZE). */
+void
+page_unpin (const void *uaddr, size_t size)
+{
+  struct thread *t = thread_current ();
+  const uint8_t *upage = pg_round_down (uaddr);
+  const uint8_t *last = pg_round_down ((const uint8_t *) uaddr
+                                       + (size > 0 ? size - 1 : 0));
+
+  lock_acquire (&page_lock);
+  for (; upage <= last; upage += PGSIZE)
+  {
+    struct page *p = page_lookup (t, upage);
+    if (p != NULL && p->location == PAGE_FRAME)
+      frame_unpin (p->kpage);
+  }
+  lock_release (&page_lock);
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the pages of the
+   current process in the SIZE bytes starting at UADDR:
+
+   MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL set how much swap
+   readahead faults on the pages get: the adaptive window, none,
+   or the most there is.
+
+   MADV_WILLNEED reads the pages that are not resident in now,
+   stopping early rather than evict other pages.
+
+   MADV_DONTNEED frees the pages' frames and swap slots.  Their
+   next access finds the original file contents or zeros, as if
+   they had never been touched; modified mmap pages are written
+   back first.
+
+   MADV_LOCK makes the pages resident and pins their frames, so
+   that they are never chosen for eviction, until MADV_UNLOCK,
+   MADV_DONTNEED or exit.  At most half of the user pool may be
+   locked.
+
+   Returns true if successful, false if any page in the range is
+   not part of the address space, ADVICE is unknown, or a page
+   could not be locked. */
+bool
+page_advise (void *uaddr, size_t size, int advice)
+{
+  struct thread *t = thread_current ();
+  uint8_t *first = pg_round_down (uaddr);
+  uint8_t *last = pg_round_down ((uint8_t *) uaddr
+                                 + (size > 0 ? size - 1 : 0));
+  uint8_t *upage;
+  bool success = true;
+  bool stop = false;
+
+  if (advice < MADV_NORMAL || advice > MADV_UNLOCK)
+    return false;
+
+  lock_acquire (&page_lock);
+  for (upage = first; upage <= last; upage += PGSIZE)
+    if (!is_user_vaddr (upage) || page_lookup (t, upage) == NULL)
+    {
+      lock_release (&page_lock);
+      return false;
+    }
+
+  for (upage = first; success && !stop && upage <= last; upage += PGSIZE)
+  {
+    struct page *p = page_lookup (t, upage);
+
+    while (p->location == PAGE_EVICTING)
+      cond_wait (&evict_done, &page_lock);
+    switch (advice)
+    {
+      case MADV_NORMAL:
+      case MADV_RANDOM:
+      case MADV_SEQUENTIAL:
+        p->advice = advice;
+        break;
+
+      case MADV_WILLNEED:
+        if (p->location == PAGE_FRAME)
+          break;
+        /* Stop rather than evict. */
+        if (palloc_free_cnt (PAL_USER) < pageout_low || !page_load (p))
+          stop = true;
+        else
+        {
+          frame_unpin (p->kpage);
+          advised_in++;
+        }
+        break;
+
+      case MADV_DONTNEED:
+        if (p->location == PAGE_FRAME)
+          advised_out++;
+        if (p->location == PAGE_FRAME && p->mapped)
+        {
+          /* Write a dirty mmap page back the way eviction does,
+             without holding page_lock over the disk write. */
+          if (p->locked)
+          {
+            frame_unpin (p->kpage);
+            p->locked = false;
+            locked_cnt--;
+          }
+          page_out (p);
+        }
+        page_drop (p);
+        if (p->swap_slot != SWAP_ERROR)
+        {
+          swap_release (p->swap_slot);
+          p->swap_slot = SWAP_ERROR;
+        }
+        p->location = p->file != NULL ? PAGE_FILE : PAGE_ZERO;
+        break;
+
+      case MADV_LOCK:
+        if (p->locked)
+          break;
+        if (locked_cnt >= locked_max)
+          success = false;
+        else if (p->location == PAGE_FRAME)
+          frame_pin (p->kpage);
+        else
+          success = page_load (p);
+        if (success)
+        {
+          p->locked = true;
+          locked_cnt++;
+        }
+        break;
+
+      case MADV_UNLOCK:
+        if (p->locked)
+        {
+          frame_unpin (p->kpage);
+          p->locked = false;
+          locked_cnt--;
+        }
+        break;
+    }
+  }
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Reads page P into a newly allocated frame and maps it.  The
+   frame is left pinned.  The caller must hold page_lock.
+   Returns true if successful, false on allocation or I/O
+   failure. */
+static bool
+page_load (struct page *p)
+{
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+
+  while (p->location == PAGE_EVICTING)
+    cond_wait (&evict_done, &page_lock);
+  ASSERT (p->location != PAGE_FRAME);
+
+  /* Read-only file pages are shared with every other process
+     that has the same page resident. */
+  if (p->location == PAGE_FILE && !p->writable)
+  {
+    kpage = text_lookup (file_get_inode (p->file), p->file_ofs,
+                         p->read_bytes);
+    if (kpage != NULL
+        && pagedir_set_page (p->owner->pagedir, p->upage, kpage, false))
+    {
+      struct frame *f = frame_lookup (kpage);
+
+      p->frame_next = f->page;
+      f->page = p;
+      page_set_location (p, PAGE_FRAME);
+      p->kpage = kpage;
+      frame_pin (kpage);
+      return true;
+    }
+  }
+
+  kpage = frame_alloc (p);
+  if (kpage == NULL)
+    return false;
+
+  switch (p->location)
+  {
+    case PAGE_ZERO_MAPPED:
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      /* Fall through. */
+    case PAGE_ZERO:
+      memset (kpage, 0, PGSIZE);
+      break;
+    case PAGE_FILE:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->file_ofs)
+          != (off_t) p->read_bytes)
+      {
+        frame_free (kpage);
+        return false;
+      }
+      memset ((uint8_t *) kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      break;
+    case PAGE_SWAP:
+      swap_swap_in (p->swap_slot, kpage);
+      break;
+    default:
+      NOT_REACHED ();
+  }
+
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, kpage, p->writable))
+  {
+    frame_free (kpage);
+    return false;
+  }
+  if (p->location == PAGE_FILE && !p->writable)
+    text_insert (file_get_inode (p->file), p->file_ofs, p->read_bytes, kpage);
+  page_set_location (p, PAGE_FRAME);
+  p->kpage = kpage;
+  p->frame_next = NULL;
+  return true;
+}
+
+/* Copies PARENT's page table into the current process, which is
+   being created by fork() and has an empty page table and page
+   directory.  Pages in frames are shared: both processes map
+   the frame read-only, and the first to write gets a copy.
+   Swap slots are shared by reference.  Memory mappings are left
+   out.  Returns true if successful, false on allocation
+   failure. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  lock_acquire (&page_lock);
+  hash_first (&i, &parent->pages);
+  while (success && hash_next (&i))
+  {
+    struct page *pp = hash_entry (hash_cur (&i), struct page, elem);
+    struct page *p;
+
+    /* PARENT is blocked in fork(), so only the page-out daemon
+       can change its pages meanwhile. */
+    while (pp->location == PAGE_EVICTING)
+      cond_wait (&evict_done, &page_lock);
+
+    /* Memory mappings are not inherited. */
+    if (pp->mapped)
+      continue;
+
+    p = page_add (pp->upage, pp->writable);
+    if (p == NULL)
+    {
+      success = false;
+      break;
+    }
+    p->file = pp->file == parent->exec_file ? t->exec_file : pp->file;
+    p->file_ofs = pp->file_ofs;
+    p->read_bytes = pp->read_bytes;
+    if (pp->swap_slot != SWAP_ERROR)
+    {
+      swap_share (pp->swap_slot);
+      p->swap_slot = pp->swap_slot;
+    }
+
+    switch (pp->location)
+    {
+      case PAGE_ZERO_MAPPED:
+        success = pagedir_set_page (t->pagedir, p->upage, zero_kpage, false);
+        break;
+      case PAGE_FRAME:
+        success = pagedir_set_page (t->pagedir, p->upage, pp->kpage, false);
+        if (success)
+        {
+          pagedir_set_writable (parent->pagedir, pp->upage, false);
+          p->kpage = pp->kpage;
+          p->frame_next = pp->frame_next;
+          pp->frame_next = p;
+        }
+        break;
+      default:
+        break;
+    }
+    if (success)
+      page_set_location (p, pp->location);
+  }
+  t->stack_bottom = parent->stack_bottom;
+  t->stack_batch = parent->stack_batch;
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Gives page P, which is in a frame, a frame of its own and maps
+   it writable.  If no other page shares P's frame any more, it
+   just becomes writable; otherwise P gets a copy.  Leaves P's
+   frame pinned.  Returns true if successful, false if no frame
+   is available. */
+static bool
+page_unshare (struct page *p)
+{
+  struct frame *f = frame_lookup (p->kpage);
+  void *old = p->kpage;
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+  ASSERT (p->location == PAGE_FRAME && p->writable);
+
+  if (f->page == p && p->frame_next == NULL)
+  {
+    pagedir_set_writable (p->owner->pagedir, p->upage, true);
+    frame_pin (old);
+    cow_reuses++;
+    return true;
+  }
+
+  /* Pin the shared frame, since frame_alloc() may evict. */
+  frame_pin (old);
+  kpage = frame_alloc (p);
+  if (kpage == NULL)
+  {
+    frame_unpin (old);
+    return false;
+  }
+  memcpy (kpage, old, PGSIZE);
+  page_unlink (p);
+  frame_unpin (old);
+  if (p->locked)
+  {
+    frame_unpin (old);
+    frame_pin (kpage);
+  }
+
+  /* The copy may differ from P's swap copy, so it is marked dirty
+     whether or not P is written now. */
+  pagedir_replace_page (p->owner->pagedir, p->upage, kpage, true);
+  pagedir_set_dirty (p->owner->pagedir, p->upage, true);
+  p->kpage = kpage;
+  p->frame_next = NULL;
+  cow_copies++;
+  return true;
+}
+
+/* Returns true if frame KPAGE may be merged with another frame
+   of the same contents: it holds only anonymous or private file
+   pages that may be written, and it is not pinned.  Read-only
+   text is already shared through the text cache, and mmap pages
+   must stay private to their file.  The caller must hold
+   page_lock. */
+bool
+page_mergeable (void *kpage)
+{
+  struct frame *f = frame_lookup (kpage);
+  struct page *p;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+
+  if (f->page == NULL || f->pin_cnt > 0)
+    return false;
+  for (p = f->page; p != NULL; p = p->frame_next)
+    if (p->location != PAGE_FRAME || !p->writable || p->mapped)
+      return false;
+  return true;
+}
+
+/* Merges frame DUP into frame KPAGE, if their contents are the
+   same: every page in DUP is mapped read-only to KPAGE and DUP is
+   freed.  A write to any of them later gets a private copy back
+   through page_unshare(), as after fork().  Both frames must be
+   page_mergeable().  Returns true if the frames were merged,
+   false if their contents differ.  The caller must hold
+   page_lock. */
+bool
+page_merge (void *kpage, void *dup)
+{
+  struct page *head = frame_lookup (kpage)->page;
+  struct page *q, *next;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+  ASSERT (kpage != dup);
+
+  /* Write-protect both first, so that neither can change between
+     the comparison and the merge. */
+  page_protect (kpage, false);
+  page_protect (dup, false);
+  if (memcmp (kpage, dup, PGSIZE))
+  {
+    page_protect (kpage, true);
+    page_protect (dup, true);
+    return false;
+  }
+
+  /* Sharers of a frame all have the same swap slot, so each page
+     of DUP takes over HEAD's.  A page whose own copy was not the
+     same is marked dirty, so that the frame gets written out. */
+  for (q = frame_lookup (dup)->page; q != NULL; q = next)
+  {
+    bool dirty = (pagedir_is_dirty (q->owner->pagedir, q->upage)
+                  || q->swap_slot != head->swap_slot);
+
+    next = q->frame_next;
+    if (q->swap_slot != head->swap_slot)
+    {
+      if (q->swap_slot != SWAP_ERROR)
+        swap_release (q->swap_slot);
+      if (head->swap_slot != SWAP_ERROR)
+        swap_share (head->swap_slot);
+      q->swap_slot = head->swap_slot;
+    }
+
+    pagedir_replace_page (q->owner->pagedir, q->upage, kpage, false);
+    if (dirty)
+      pagedir_set_dirty (q->owner->pagedir, q->upage, true);
+    q->kpage = kpage;
+    q->frame_next = head->frame_next;
+    head->frame_next = q;
+  }
+  frame_free (dup);
+  return true;
+}
+
+/* Frees frame KPAGE if it is all zeros, mapping each of its pages
+   to the shared zero page instead, as if it had only been read.
+   KPAGE must be page_mergeable().  Returns true if successful,
+   false if KPAGE is not all zeros.  The caller must hold
+   page_lock. */
+bool
+page_merge_zero (void *kpage)
+{
+  struct page *q, *next;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+
+  page_protect (kpage, false);
+  if (memcmp (kpage, zero_kpage, PGSIZE))
+  {
+    page_protect (kpage, true);
+    return false;
+  }
+
+  for (q = frame_lookup (kpage)->page; q != NULL; q = next)
+  {
+    next = q->frame_next;
+    if (q->swap_slot != SWAP_ERROR)
+    {
+      swap_release (q->swap_slot);
+      q->swap_slot = SWAP_ERROR;
+    }
+    pagedir_replace_page (q->owner->pagedir, q->upage, zero_kpage, false);
+    page_set_location (q, PAGE_ZERO_MAPPED);
+    q->kpage = NULL;
+    q->frame_next = NULL;
+  }
+  frame_free (kpage);
+  return true;
+}
+
+/* Empties frame KPAGE so that it can be freed, for example to
+   give its memory back to the kernel pool.  A clean frame is
+   dropped as by page_out(); a dirty one is copied to another user
+   frame and its pages are mapped there.  Nothing is written to
+   disk, so page_lock is held throughout.  Returns true if KPAGE
+   was freed, false if it is pinned or no other frame is free.
+   The caller must hold page_lock. */
+bool
+page_migrate (void *kpage)
+{
+  struct frame *f = frame_lookup (kpage);
+  struct page *head = f->page;
+  struct page *q;
+  bool writable, dirty = false;
+  void *new;
+
+  ASSERT (lock_held_by_current_thread (&page_lock));
+
+  if (head == NULL || f->pin_cnt > 0)
+    return false;
+
+  /* Write-protect first, so that the dirty bits cannot change
+     under the check or the copy. */
+  writable = (head->frame_next == NULL
+              && pagedir_is_writable (head->owner->pagedir, head->upage));
+  page_protect (kpage, false);
+  for (q = head; q != NULL; q = q->frame_next)
+    dirty = dirty || pagedir_is_dirty (q->owner->pagedir, q->upage);
+  if (!dirty)
+    return page_out (head);
+
+  new = palloc_get_page (PAL_USER);
+  if (new == NULL)
+  {
+    page_protect (kpage, writable);
+    return false;
+  }
+  memcpy (new, kpage, PGSIZE);
+
+  for (q = head; q != NULL; q = q->frame_next)
+  {
+    uint32_t *pd = q->owner->pagedir;
+    bool accessed = pagedir_is_accessed (pd, q->upage);
+
+    dirty = pagedir_is_dirty (pd, q->upage);
+    pagedir_replace_page (pd, q->upage, new, writable);
+    pagedir_set_dirty (pd, q->upage, dirty);
+    pagedir_set_accessed (pd, q->upage, accessed);
+    q->kpage = new;
+  }
+  frame_set_page (new, head);
+  frame_lookup (new)->cksum = f->cksum;
+  vm_frame_added (frame_lookup (new));
+  frame_free (kpage);
+  migrations++;
+  return true;
+}
+
+/* Sets whether the page in frame KPAGE may be written, if it is
+   the frame's only page.  Frames with several pages are always
+   read-only. */
+static void
+page_protect (void *kpage, bool writable)
+{
+  struct page *p = frame_lookup (kpage)->page;
+
+  if (p->frame_next == NULL)
+    pagedir_set_writable (p->owner->pagedir, p->upage, writable);
+}
+
+/* Unmaps page P and releases its frame, if it has one, leaving it
+   PAGE_ZERO if it was resident.  The caller decides where its
+   contents live from then on. */
+static void
+page_drop (struct page *p)
+{
+  while (p->location == PAGE_EVICTING)
+    cond_wait (&evict_done, &page_lock);
+  if (p->location == PAGE_FRAME)
+  {
+    struct frame *f = frame_lookup (p->kpage);
+
+    if (p->locked)
+    {
+      frame_unpin (p->kpage);
+      p->locked = false;
+      locked_cnt--;
+    }
+    if (f->page == p && p->frame_next == NULL)
+      page_free_frame (p, p->kpage);
+    else
+      page_unlink (p);
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+    page_set_location (p, PAGE_ZERO);
+  }
+  else if (p->location == PAGE_ZERO_MAPPED)
+  {
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+    page_set_location (p, PAGE_ZERO);
+  }
+}
+
+/* Frees frame KPAGE, of which P was the last page, dropping it
+   from the text cache if it is there. */
+static void
+page_free_frame (struct page *p, void *kpage)
+{
+  if (!p->writable && p->file != NULL)
+    text_remove (file_get_inode (p->file), p->file_ofs, p->read_bytes, kpage);
+  frame_free (kpage);
+}
+
+/* Removes page P from the pages sharing its frame, which must
+   have others.  P's dirty bit is handed on to a remaining page,
+   so that the frame is still written back if needed. */
+static void
+page_unlink (struct page *p)
+{
+  struct frame *f = frame_lookup (p->kpage);
+  struct page **pp = &f->page;
+
+  while (*pp != p)
+  {
+    ASSERT (*pp != NULL);
+    pp = &(*pp)->frame_next;
+  }
+  *pp = p->frame_next;
+  p->frame_next = NULL;
+
+  ASSERT (f->page != NULL);
+  if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+    pagedir_set_dirty (f->page->owner->pagedir, f->page->upage, true);
+}
+
+/* Prints paging statistics. */
+void
+page_print_stats (void)
+{
+  printf ("readahead : %u pages, %u hits\n", ra_pages, ra_hits);
+  printf ("clean drops : %u\n", clean_drops);
+  printf ("mmap write-backs : %u\n", mapped_writes);
+  printf ("zero page maps : %u\n", zero_maps);
+  printf ("copy-on-write : %u copies, %u reuses\n", cow_copies, cow_reuses);
+  printf ("working set targets : %u raised, %u lowered\n",
+          target_grows, target_shrinks);
+  printf ("madvise : %u pages prefetched, %u discarded, %zu locked\n",
+          advised_in, advised_out, locked_cnt);
+  printf ("stack growth : %u times, %u pages prefaulted\n",
+          stack_grows, stack_prefaults);
+  printf ("frame migrations : %u\n", migrations);
+  text_print_stats ();
+  ksm_print_stats ();
+}
+
+/* Called after page P was read back from swap SLOT.  Grades the
+   previous readahead of P's owner by how many of its pages were
+   accessed since, resizes the window to match, and then reads in
+   the virtually following pages that sit in the following swap
+   slots, up to the window size.  The pages are mapped with their
+   accessed bit clear, so unused ones are the first to be evicted
+   again.  Readahead stops at the page-out daemon's low
+   watermark rather than cause an eviction. */
+static void
+page_readahead (struct page *p, size_t slot)
+{
+  struct thread *t = p->owner;
+  uint8_t *upage;
+  unsigned hits = 0;
+  unsigned window;
+  unsigned i;
+
+  if (p->advice == MADV_RANDOM)
+    return;
+  if (t->ra_cnt > 0)
+  {
+    for (i = 0, upage = t->ra_upage; i < t->ra_cnt; i++, upage += PGSIZE)
+    {
+      struct page *q = page_lookup (t, upage);
+      if (q != NULL && q->location == PAGE_FRAME
+          && pagedir_is_accessed (t->pagedir, upage))
+        hits++;
+    }
+    ra_hits += hits;
+    if (hits * 4 >= t->ra_cnt * 3 && t->ra_window < RA_MAX)
+      t->ra_window *= 2;
+    else if (hits * 4 < t->ra_cnt && t->ra_window > RA_MIN)
+      t->ra_window /= 2;
+  }
+
+  window = p->advice == MADV_SEQUENTIAL ? RA_MAX : t->ra_window;
+  t->ra_upage = (uint8_t *) p->upage + PGSIZE;
+  t->ra_cnt = 0;
+  for (i = 1; i < window; i++)
+  {
+    struct page *q;
+
+    upage = (uint8_t *) p->upage + i * PGSIZE;
+    if (!is_user_vaddr (upage) || palloc_free_cnt (PAL_USER) < pageout_low)
+      break;
+    q = page_lookup (t, upage);
+    if (q == NULL || q->location != PAGE_SWAP || q->swap_slot != slot + i
+        || !page_load (q))
+      break;
+    frame_unpin (q->kpage);
+    t->ra_cnt++;
+    ra_pages++;
+  }
+}
+
+/* Returns the swap slot P would best be written to: right after
+   the slot of the page below it, or right before the slot of the
+   page above it, so that swap_swap_in() readahead finds
+   virtually adjacent pages in adjacent slots.  Returns
+   SWAP_ERROR if neither neighbour has a slot. */
+static size_t
+page_swap_hint (struct page *p)
+{
+  struct page *q;
+
+  q = page_lookup (p->owner, (uint8_t *) p->upage - PGSIZE);
+  if (q != NULL && q->swap_slot != SWAP_ERROR)
+    return q->swap_slot + 1;
+  q = page_lookup (p->owner, (uint8_t *) p->upage + PGSIZE);
+  if (q != NULL && q->swap_slot != SWAP_ERROR && q->swap_slot > 0)
+    return q->swap_slot - 1;
+  return SWAP_ERROR;
+}
+
+/* Sets the location of page P to LOC, keeping its owner's
+   resident set size up to date. */
+static void
+page_set_location (struct page *p, enum page_location loc)
+{
+  struct thread *t = p->owner;
+
+  if (p->location == PAGE_FRAME && loc != PAGE_FRAME)
+    page_set_rss (t, t->rss - 1, t->rss_target);
+  else if (p->location != PAGE_FRAME && loc == PAGE_FRAME)
+    page_set_rss (t, t->rss + 1, t->rss_target);
+  p->location = loc;
+}
+
+/* Sets T's resident set size to RSS and its target to TARGET,
+   keeping page_over_target_cnt up to date. */
+static void
+page_set_rss (struct thread *t, size_t rss, size_t target)
+{
+  bool was_over = t->rss > t->rss_target;
+  bool is_over = rss > target;
+
+  if (!was_over && is_over)
+    page_over_target_cnt++;
+  else if (was_over && !is_over)
+    page_over_target_cnt--;
+  t->rss = rss;
+  t->rss_target = target;
+}
+
+/* Counts a page fault by process T and, at the end of a counting
+   window, moves T's working set target according to its fault
+   rate. */
+static void
+page_count_fault (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+  unsigned windows;
+  size_t target = t->rss_target;
+
+  t->pff_faults++;
+  if (now - t->pff_start < PFF_WINDOW)
+    return;
+
+  windows = (now - t->pff_start) / PFF_WINDOW;
+  if (t->pff_faults > PFF_HIGH * windows)
+  {
+    target += t->pff_faults - PFF_HIGH * windows;
+    target_grows++;
+  }
+  else if (t->pff_faults < PFF_LOW * windows)
+  {
+    for (; windows > 0 && target > PFF_MIN_TARGET; windows--)
+      target -= target / 4;
+    target_shrinks++;
+  }
+  if (target < PFF_MIN_TARGET)
+    target = PFF_MIN_TARGET;
+  if (page_rss_limit != 0 && target > page_rss_limit)
+    target = page_rss_limit;
+  page_set_rss (t, t->rss, target);
+
+  t->pff_start = now;
+  t->pff_faults = 0;
+}
+
+/* Adds an entry for UPAGE to the current process's page table
+   and returns it, or returns a null pointer if UPAGE is already
+   present or on allocation failure.  The new page reads as
+   zeros. */
+static struct page *
+page_add (void *upage, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = calloc (1, sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->owner = t;
+  p->upage = upage;
+  p->writable = writable;
+  p->location = PAGE_ZERO;
+  p->swap_slot = SWAP_ERROR;
+  if (hash_insert (&t->pages, &p->elem) != NULL)
+  {
+    free (p);
+    return NULL;
+  }
+  return p;
+}
+
+/* Hash function for the page table. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Orders page table entries by user address. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Frees a page table entry and the frame or swap slot it
+   holds. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  page_drop (p);
+  if (p->swap_slot != SWAP_ERROR)
+    swap_release (p->swap_slot);
+  vm_page_removed (p);
+  free (p);
+}
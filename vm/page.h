@@ -0,0 +1,97 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <fault-stats.h>
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/swap.h"
+
+/* Where the contents of a user page currently live. */
+enum page_location
+  {
+    PAGE_ZERO,                  /* Not yet touched, all zeros. */
+    PAGE_ZERO_MAPPED,           /* Only read, mapped to the zero page. */
+    PAGE_FILE,                  /* Not yet touched, read from a file. */
+    PAGE_SWAP,                  /* In a swap slot. */
+    PAGE_FRAME,                 /* In a user frame. */
+    PAGE_EVICTING               /* Unmapped, being written to swap. */
+  };
+
+/* Advice for page_advise().  Must match lib/user/syscall.h. */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* No readahead. */
+#define MADV_SEQUENTIAL 2       /* Maximum readahead. */
+#define MADV_WILLNEED 3         /* Bring into memory now. */
+#define MADV_DONTNEED 4         /* Discard contents, free frames. */
+#define MADV_LOCK 5             /* Keep in memory. */
+#define MADV_UNLOCK 6           /* Undo MADV_LOCK. */
+
+/* Supplemental page table entry.
+   Each process keeps one of these per user virtual page it has
+   in its address space, in a hash table keyed by UPAGE. */
+struct page
+  {
+    struct hash_elem elem;      /* Element in owner's page table. */
+    struct thread *owner;       /* Owning process. */
+    void *upage;                /* User virtual page. */
+    bool writable;              /* Writable by the user? */
+    enum page_location location;
+
+    void *kpage;                /* PAGE_FRAME, PAGE_EVICTING: frame. */
+    size_t swap_slot;           /* Swap slot, or SWAP_ERROR if none.
+                                   Kept after swap-in, so a clean
+                                   page can be dropped again. */
+
+    struct page *frame_next;    /* Next page sharing the frame. */
+
+    int advice;                 /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+    bool locked;                /* MADV_LOCK: frame pinned for us. */
+
+    /* Replacement policy history, see vm/vm.c. */
+    struct list_elem ghost_elem; /* Element in a ghost queue. */
+    int ghost;                  /* Ghost queue, enum vm_queue. */
+
+    /* PAGE_FILE, and reloads of clean pages without a slot. */
+    bool mapped;                /* mmap page: written back to FILE. */
+    struct file *file;          /* File to read from. */
+    off_t file_ofs;             /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read, rest is zeroed. */
+  };
+
+extern struct lock page_lock;
+extern size_t page_rss_limit;
+extern unsigned page_over_target_cnt;
+extern size_t page_stack_limit;
+
+void page_init (void);
+bool page_table_create (void);
+bool page_table_copy (struct thread *parent);
+void page_table_destroy (void);
+
+struct page *page_lookup (struct thread *, const void *vaddr);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_mapped (void *upage, struct file *, off_t ofs,
+                      size_t read_bytes);
+void page_remove (void *upage);
+bool page_in (void *fault_addr, bool write, enum fault_type *);
+bool page_grow_stack (const void *fault_addr, const void *esp);
+bool page_out (struct page *);
+bool page_wait_evicting (void);
+bool page_over_limit (struct thread *);
+bool page_pin (const void *uaddr, size_t size, bool write);
+void page_unpin (const void *uaddr, size_t size);
+bool page_advise (void *uaddr, size_t size, int advice);
+bool page_mergeable (void *kpage);
+bool page_merge (void *kpage, void *dup);
+bool page_merge_zero (void *kpage);
+bool page_migrate (void *kpage);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
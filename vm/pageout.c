@@ -0,0 +1,78 @@
+#include "vm/pageout.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/vm.h"
+
+/* The page-out daemon keeps free user frames between the low and
+   high watermarks, so that page faults normally find a free frame
+   and do not wait for a swap write.  frame_alloc() wakes it when
+   the pool drops below pageout_low; it then evicts until the pool
+   is back at pageout_high.  Below pageout_min, faulting threads
+   evict for themselves. */
+size_t pageout_min;
+size_t pageout_low;
+size_t pageout_high;
+
+/* Signaled to wake the daemon.  Used with page_lock. */
+static struct condition pageout_cond;
+
+/* Statistics. */
+static unsigned pageout_wakeups, pageout_pages;
+
+static thread_func pageout_daemon NO_RETURN;
+
+/* Sets the watermarks from the size of the user pool and starts
+   the daemon.  Call after thread_start(). */
+void
+pageout_init (void)
+{
+  size_t user_pages = palloc_free_cnt (PAL_USER);
+
+  pageout_low = user_pages / 32 + 4;
+  pageout_high = pageout_low * 2;
+  pageout_min = pageout_low / 4;
+  cond_init (&pageout_cond);
+  thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+/* Wakes the daemon if free user frames are below the low
+   watermark.  The caller must hold page_lock. */
+void
+pageout_kick (void)
+{
+  if (palloc_free_cnt (PAL_USER) < pageout_low)
+    cond_signal (&pageout_cond, &page_lock);
+}
+
+/* Prints page-out statistics. */
+void
+pageout_print_stats (void)
+{
+  printf ("Page-out: %u wakeups, %u pages\n", pageout_wakeups, pageout_pages);
+}
+
+/* Page-out daemon.  Evicts with the normal replacement policy;
+   page_out() drops page_lock during each swap write, so faults
+   proceed while the daemon waits for the disk. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+  lock_acquire (&page_lock);
+  for (;;)
+    {
+      cond_wait (&pageout_cond, &page_lock);
+      pageout_wakeups++;
+      while (palloc_free_cnt (PAL_USER) < pageout_high)
+        {
+          struct frame *f = select_victim_page ();
+          if (f == NULL || !page_out (f->page))
+            break;
+          pageout_pages++;
+        }
+    }
+}
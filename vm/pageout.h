@@ -0,0 +1,15 @@
+#ifndef VM_PAGEOUT_H
+#define VM_PAGEOUT_H
+
+#include <stddef.h>
+
+/* Free user frame watermarks. */
+extern size_t pageout_min;
+extern size_t pageout_low;
+extern size_t pageout_high;
+
+void pageout_init (void);
+void pageout_kick (void);
+void pageout_print_stats (void);
+
+#endif /* vm/pageout.h */
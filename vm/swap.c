@@ -2,154 +2,137 @@
 #include <string.h>
 #include <bitmap.h>
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #include "threads/malloc.h"
-#include "threads/palloc.h"
-#include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
-#include "userprog/pagedir.h"
 
-#define SECTORS_FOR_A_PAGE PGSIZE / DISK_SECTOR_SIZE
+#define SECTORS_FOR_A_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 
-struct swap_page
-{
-  struct list_elem elem;
-  tid_t tid;
-  uint32_t page_number;
-  bool writable;
-  disk_sector_t sector;
-};
-
-struct list swap_table;
+/* Swap is divided into page-sized slots.  A slot is read or
+   written in one multi-sector request, straight from or into the
+   frame, without bouncing through a sector buffer.  The
+   compressed cache in vm/zswap.c sits in front of the disk and
+   keeps what compresses well in memory. */
 static struct disk *swap_disk;
-static disk_sector_t n_sectors;
-static struct bitmap *swap_pool;
+static size_t n_slots;
+static struct bitmap *swap_pool;        /* true: slot is in use. */
+static uint16_t *slot_refs;             /* Pages referring to each slot. */
+static size_t next_slot;                /* Next-fit hint. */
+static struct lock swap_lock;
+
+static uint32_t swapped_in, swapped_out, released, disk_writes;
 
-static uint32_t swapped_in, swapped_out, released;
+static void write_slot(size_t slot, const void *page);
 
 void swap_swap_disk_init(void)
 {  
-  list_init(&swap_table);
   swap_disk = disk_get(1, 1);
-  n_sectors = disk_size(swap_disk);
-  printf("Size of Swap Disk : %d\n", (int)n_sectors);
+  n_slots = swap_disk != NULL ? disk_size(swap_disk) / SECTORS_FOR_A_PAGE : 0;
+  printf("Size of Swap Disk : %d pages\n", (int)n_slots);
   
   swapped_in = 0;
   swapped_out = 0;
   released = 0;
+  next_slot = 0;
   
-  bitmap_set_all(swap_pool = bitmap_create(n_sectors), true);
+  lock_init(&swap_lock);
+  swap_pool = bitmap_create(n_slots);
+  slot_refs = calloc(n_slots, sizeof *slot_refs);
+  if (swap_pool == NULL || (n_slots > 0 && slot_refs == NULL))
+    PANIC("Not enough memory for swap bitmap.");
+  zswap_init(n_slots, write_slot);
 }
 
-bool swap_swap_in(void *vaddr)
+/* Reads the page stored in SLOT into KPAGE.  The slot stays
+   allocated, so that the page can be dropped again without a
+   write if it is not modified; free it with swap_release(). */
+void swap_swap_in(size_t slot, void *kpage)
 {
-  struct list_elem *e;
-  struct swap_page *p;
-  struct thread *t = thread_current();
-  char disk_buffer[DISK_SECTOR_SIZE], *page_swaped_in;
-  int i;
+  if (!zswap_load(slot, kpage))
+    disk_read_multiple(swap_disk, slot * SECTORS_FOR_A_PAGE, kpage,
+                       SECTORS_FOR_A_PAGE);
   
-  for (e = list_begin(&swap_table) ; e != list_end(&swap_table) ; e = list_next(e))
-  {
-    p = list_entry(e, struct swap_page, elem);
-    if (p->page_number == ((uintptr_t)vaddr & PTE_ADDR))
-    {
-      page_swaped_in = palloc_get_page(PAL_USER);
-      
-      for (i = 0 ; i < SECTORS_FOR_A_PAGE ; i++)
-      {
-        disk_read(swap_disk, p->sector + i, disk_buffer);
-        memcpy(page_swaped_in + i * DISK_SECTOR_SIZE, disk_buffer,
-               DISK_SECTOR_SIZE);
-      } 
-      bitmap_set_multiple(swap_pool, p->sector, SECTORS_FOR_A_PAGE, true);
-      pagedir_set_page(t->pagedir, p->page_number, page_swaped_in, p->writable);
-      list_remove(e);
-      free(p);
-      
-      swapped_in++;
-      return true;
-    }
-  }
-  return false;
+  swapped_in++;
 }
 
-bool swap_swap_out(struct thread *t, void *vpage)
+/* Allocates a free swap slot and returns it, or SWAP_ERROR if
+   swap is full.  Slot HINT is used if it is free, so that
+   neighbouring pages can be kept in neighbouring slots; pass
+   SWAP_ERROR for no preference.  Otherwise slots are handed out
+   next-fit, continuing after the slot handed out last. */
+size_t swap_alloc(size_t hint)
 {
-  int i, sector = 0;
-  static char disk_buffer[DISK_SECTOR_SIZE];
-  struct swap_page *p = calloc (1, sizeof *p);
-  char *kpage;
+  size_t slot = BITMAP_ERROR;
   
-  if (p != NULL)
+  lock_acquire(&swap_lock);
+  if (hint < n_slots && !bitmap_test(swap_pool, hint))
   {
-    
-    p->tid = t->tid;
-    p->page_number = (uintptr_t)vpage;
-    p->writable = pagedir_is_writable(t->pagedir, vpage);
-    kpage = pagedir_get_page(t->pagedir, vpage);
-    
-    sector = bitmap_scan(swap_pool, 0, SECTORS_FOR_A_PAGE, true);
-    for (i = 0 ; i < (PGSIZE / DISK_SECTOR_SIZE) ; i++)
-    {
-      memcpy(disk_buffer, kpage + i * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE);
-      
-      disk_write(swap_disk, sector + i, disk_buffer);
-    }
-    p->sector = sector;
-    bitmap_set_multiple(swap_pool, sector, SECTORS_FOR_A_PAGE, false);
-    pagedir_clear_page(t->pagedir, vpage);
-    palloc_free_page(kpage);
-    list_push_back(&swap_table, &p->elem);
-    
-    swapped_out++;
-    return true;
+    bitmap_mark(swap_pool, hint);
+    slot = hint;
   }
-  else
+  if (slot == BITMAP_ERROR)
+    slot = bitmap_scan_and_flip(swap_pool, next_slot, 1, false);
+  if (slot == BITMAP_ERROR)
+    slot = bitmap_scan_and_flip(swap_pool, 0, 1, false);
+  if (slot != BITMAP_ERROR)
   {
-    return false;
-  }  
+    next_slot = slot + 1 < n_slots ? slot + 1 : 0;
+    slot_refs[slot] = 1;
+  }
+  lock_release(&swap_lock);
+  return slot != BITMAP_ERROR ? slot : SWAP_ERROR;
 }
 
-int swap_release_swaped_page_of(tid_t t)
+/* Writes KPAGE to SLOT, which must have been allocated with
+   swap_alloc(), through the compressed cache.  swap_lock is not
+   held across the write, so several pages may be in flight at
+   once. */
+void swap_swap_out(size_t slot, const void *kpage)
 {
-  struct swap_page *p;
-  struct list_elem *e = list_begin(&swap_table);
-  int count = 0;
+  if (!zswap_store(slot, kpage))
+    write_slot(slot, kpage);
   
-  while(e != list_end(&swap_table))
-  {
-    p = list_entry(e, struct swap_page, elem);
-    
-    if (p->tid == t)
-    {
-      bitmap_reset(swap_pool, p->sector);
-      e = list_remove(e);
-      free(p);
-    }
-    count++;
-  }
-  
-  released += count;
-  return count;
+  swapped_out++;
 }
 
-/* if designated address is in swap table, return disk sector number.
-   if not, return 0.  */
-bool swap_is_in_swap_table(void *vaddr)
+/* Writes PAGE to SLOT on the swap disk. */
+static void write_slot(size_t slot, const void *page)
 {
-  uint32_t page_number = ((uintptr_t)vaddr & PTE_ADDR);
-  struct swap_page *p;
-  struct list_elem *e;
-  
-  for (e = list_begin(&swap_table) ; e != list_end(&swap_table) ; e = list_next(e))
+  disk_write_multiple(swap_disk, slot * SECTORS_FOR_A_PAGE, page,
+                      SECTORS_FOR_A_PAGE);
+  disk_writes++;
+}
+
+/* Adds a reference to SLOT, for a page that shares another
+   page's swap copy after fork(). */
+void swap_share(size_t slot)
+{
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(swap_pool, slot));
+  slot_refs[slot]++;
+  lock_release(&swap_lock);
+}
+
+/* Returns the number of pages referring to SLOT. */
+size_t swap_ref_cnt(size_t slot)
+{
+  return slot_refs[slot];
+}
+
+/* Drops a reference to SLOT, once its page no longer needs the
+   swap copy.  The slot is freed with the last reference. */
+void swap_release(size_t slot)
+{
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(swap_pool, slot) && slot_refs[slot] > 0);
+  if (--slot_refs[slot] == 0)
   {
-    p = list_entry(e, struct swap_page, elem);
-    if (p->page_number == page_number)
-    {
-      return true;
-    }
+    zswap_invalidate(slot);
+    bitmap_reset(swap_pool, slot);
+    released++;
   }
-  return false;
+  lock_release(&swap_lock);
 }
 
 void swap_print_stats(void)
@@ -157,4 +140,6 @@ void swap_print_stats(void)
   printf("swapped in : %u\n", swapped_in);
   printf("swapped out : %u\n", swapped_out);
   printf("released : %u\n", released);
+  printf("swap disk writes : %u\n", disk_writes);
+  zswap_print_stats();
 }
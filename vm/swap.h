@@ -1,15 +1,21 @@
-#include <list.h>
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "devices/disk.h"
-#include "threads/thread.h"
 
-//extern struct list swap_table;
+/* Returned by swap_alloc() when swap is full. */
+#define SWAP_ERROR SIZE_MAX
 
 void swap_swap_disk_init(void);
-bool swap_swap_in(void *vaddr);
-bool swap_swap_out(struct thread *t, void *vpage);
-bool swap_is_in_swap_table(void *vaddr);
-int swap_release_swaped_page_of(tid_t tid);
+void swap_swap_in(size_t slot, void *kpage);
+size_t swap_alloc(size_t hint);
+void swap_swap_out(size_t slot, const void *kpage);
+void swap_share(size_t slot);
+size_t swap_ref_cnt(size_t slot);
+void swap_release(size_t slot);
 void swap_print_stats(void);
 
+#endif /* vm/swap.h */
@@ -0,0 +1,144 @@
+#include "vm/text.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+
+/* Shared text cache.
+
+   Maps each read-only file page that is resident, identified by
+   its inode, file offset and number of bytes read, to the frame
+   that holds it, so that every process running the same
+   executable maps the same frame.  The pages mapping a frame are
+   chained from its frame table entry, and that chain is the
+   reference count: the entry is removed when the last page lets
+   go of the frame or it is evicted.
+
+   An entry only exists while some process maps the page, and
+   such a process holds its executable open with writes denied,
+   so a cached page can never go stale through inode_write_at().
+
+   Protected by page_lock in vm/page.c. */
+
+struct text_page
+  {
+    struct hash_elem elem;
+    struct inode *inode;
+    off_t ofs;
+    size_t read_bytes;
+    void *kpage;                /* Frame holding the page. */
+  };
+
+static struct hash text_pages;
+
+/* Statistics. */
+static unsigned text_hits, text_misses;
+
+static unsigned text_hash (const struct hash_elem *, void *);
+static bool text_less (const struct hash_elem *, const struct hash_elem *,
+                       void *);
+static struct text_page *text_find (struct inode *, off_t, size_t);
+
+/* Initializes the text cache. */
+void
+text_init (void)
+{
+  if (!hash_init (&text_pages, text_hash, text_less, NULL))
+    PANIC ("text_init: out of memory");
+}
+
+/* Returns the frame holding READ_BYTES bytes of INODE from OFS,
+   or a null pointer if no process has it resident. */
+void *
+text_lookup (struct inode *inode, off_t ofs, size_t read_bytes)
+{
+  struct text_page *t = text_find (inode, ofs, read_bytes);
+
+  if (t == NULL)
+    {
+      text_misses++;
+      return NULL;
+    }
+  text_hits++;
+  return t->kpage;
+}
+
+/* Records that KPAGE holds READ_BYTES bytes of INODE from OFS.
+   If memory is short the page is simply not shared. */
+void
+text_insert (struct inode *inode, off_t ofs, size_t read_bytes, void *kpage)
+{
+  struct text_page *t = malloc (sizeof *t);
+
+  if (t == NULL)
+    return;
+  t->inode = inode;
+  t->ofs = ofs;
+  t->read_bytes = read_bytes;
+  t->kpage = kpage;
+  if (hash_insert (&text_pages, &t->elem) != NULL)
+    free (t);
+}
+
+/* Forgets the entry for READ_BYTES bytes of INODE from OFS, if
+   it is held by KPAGE, which is about to be freed. */
+void
+text_remove (struct inode *inode, off_t ofs, size_t read_bytes, void *kpage)
+{
+  struct text_page *t = text_find (inode, ofs, read_bytes);
+
+  if (t != NULL && t->kpage == kpage)
+    {
+      hash_delete (&text_pages, &t->elem);
+      free (t);
+    }
+}
+
+/* Prints text cache statistics. */
+void
+text_print_stats (void)
+{
+  printf ("text cache : %u hits, %u misses, %zu pages\n",
+          text_hits, text_misses, hash_size (&text_pages));
+}
+
+static struct text_page *
+text_find (struct inode *inode, off_t ofs, size_t read_bytes)
+{
+  struct text_page key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  e = hash_find (&text_pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct text_page, elem) : NULL;
+}
+
+/* Hash function for the text cache. */
+static unsigned
+text_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct text_page *t = hash_entry (e, struct text_page, elem);
+  unsigned key[3];
+
+  key[0] = (unsigned) t->inode;
+  key[1] = t->ofs;
+  key[2] = t->read_bytes;
+  return hash_bytes (key, sizeof key);
+}
+
+/* Ordering function for the text cache. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct text_page *a = hash_entry (a_, struct text_page, elem);
+  const struct text_page *b = hash_entry (b_, struct text_page, elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
@@ -0,0 +1,15 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct inode;
+
+void text_init (void);
+void *text_lookup (struct inode *, off_t ofs, size_t read_bytes);
+void text_insert (struct inode *, off_t ofs, size_t read_bytes, void *kpage);
+void text_remove (struct inode *, off_t ofs, size_t read_bytes, void *kpage);
+void text_print_stats (void);
+
+#endif /* vm/text.h */
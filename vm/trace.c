@@ -0,0 +1,93 @@
+#include "vm/trace.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+/* Page fault trace.  With -vmtrace, every fault that loads a page
+   into a frame is recorded on the scratch disk (hd1:0), for
+   replay against other replacement policies with utils/vmtrace.
+   Records are buffered a sector at a time.  The scratch disk
+   must not also be used for extracting or getting files. */
+bool trace_enabled;
+
+#define RECORDS_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (struct trace_record))
+
+static struct disk *trace_disk;
+static struct lock trace_lock;
+static struct trace_record buffer[RECORDS_PER_SECTOR];
+static uint32_t record_cnt;     /* Records written or buffered. */
+static uint32_t max_records;    /* Records that fit on the disk. */
+
+static void write_header (void);
+
+/* Opens the scratch disk for the trace, if -vmtrace was given.
+   Call after disk_init(). */
+void
+trace_init (void)
+{
+  if (!trace_enabled)
+    return;
+
+  trace_disk = disk_get (1, 0);
+  if (trace_disk == NULL)
+    PANIC ("-vmtrace: no scratch disk");
+  lock_init (&trace_lock);
+  max_records = (disk_size (trace_disk) - 1) * RECORDS_PER_SECTOR;
+  write_header ();
+  printf ("Tracing page faults to scratch disk (%u records max)\n",
+          max_records);
+}
+
+/* Records a fault on UPAGE by thread TID. */
+void
+trace_fault (const void *upage, tid_t tid)
+{
+  struct trace_record *r;
+
+  if (!trace_enabled)
+    return;
+
+  lock_acquire (&trace_lock);
+  if (record_cnt < max_records)
+    {
+      r = &buffer[record_cnt % RECORDS_PER_SECTOR];
+      r->upage = (uint32_t) upage;
+      r->tid = tid;
+      r->tick = timer_ticks ();
+      if (++record_cnt % RECORDS_PER_SECTOR == 0)
+        {
+          disk_write (trace_disk, record_cnt / RECORDS_PER_SECTOR, buffer);
+          memset (buffer, 0, sizeof buffer);
+        }
+    }
+  lock_release (&trace_lock);
+}
+
+/* Writes out the last partial sector and the record count. */
+void
+trace_done (void)
+{
+  if (!trace_enabled)
+    return;
+
+  lock_acquire (&trace_lock);
+  if (record_cnt % RECORDS_PER_SECTOR != 0)
+    disk_write (trace_disk, record_cnt / RECORDS_PER_SECTOR + 1, buffer);
+  write_header ();
+  lock_release (&trace_lock);
+  printf ("Page fault trace: %u records\n", record_cnt);
+}
+
+/* Writes the trace header to sector 0. */
+static void
+write_header (void)
+{
+  static uint32_t header[DISK_SECTOR_SIZE / sizeof (uint32_t)];
+
+  header[0] = TRACE_MAGIC;
+  header[1] = record_cnt;
+  disk_write (trace_disk, 0, header);
+}
@@ -0,0 +1,28 @@
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Page fault trace record, as stored on the scratch disk.  Also
+   read by utils/vmtrace.c. */
+struct trace_record
+  {
+    uint32_t upage;             /* Faulting user page. */
+    int32_t tid;                /* Faulting process. */
+    int64_t tick;               /* Timer ticks since boot. */
+  };
+
+/* First sector of the trace: TRACE_MAGIC, then the number of
+   records, which follow from sector 1 on. */
+#define TRACE_MAGIC 0x52544d56  /* "VMTR". */
+
+/* Write a fault trace to the scratch disk? */
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_fault (const void *upage, tid_t);
+void trace_done (void);
+
+#endif /* vm/trace.h */
@@ -1,58 +1,523 @@
+#include <debug.h>
 #include <list.h>
 #include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
-#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 #include "vm/vm.h"
 #include "vm/frame.h"
-#include "threads/palloc.h"
-#include "threads/pte.h"
-
-void *
-select_victim_page(struct thread **t)
-{
-  struct list_elem *e;
-  struct pagedir_list_entry *ple;
-  uint32_t *pd;
-  uint32_t *pde;
-  int turn = 0;
-  
-SEARCH_VICTIM:  
-  
-  for (e = list_begin(&pagedir_list) ; e != list_end(&pagedir_list) ; e = list_next(e))
-  {
-    pd = (ple = list_entry(e, struct pagedir_list_entry, elem)) -> pagedir.pagedir_ptr;
-    *t = ple->pagedir.owner;
-    
-    for (pde = pd ; pde < pd + pd_no (PHYS_BASE) ; pde++)
+#include "vm/page.h"
+
+/* Page replacement.  The policy is chosen at boot with -vmpolicy
+   and decides which frame select_victim_page() hands to
+   page_out().  All policies see page use only through the
+   accessed bits of the pages sharing a frame, which they clear
+   as they sample them.
+
+   The list based policies keep their frames in queues through
+   struct frame's elem member, and remember recently evicted
+   pages in ghost queues through struct page's ghost_elem
+   member.  Everything here is protected by page_lock. */
+
+/* Queue of frames or of evicted pages. */
+struct queue
+  {
+    struct list list;
+    size_t cnt;
+  };
+
+/* A replacement policy. */
+struct vm_policy
+  {
+    const char *name;
+    struct frame *(*select)(void);      /* Choose a victim. */
+    void (*add)(struct frame *);        /* Frame was loaded. */
+    void (*evicted)(struct frame *);    /* Frame's pages were evicted. */
+  };
+
+static struct frame *clock_select(void);
+static struct frame *wsclock_select(void);
+static struct frame *aging_select(void);
+static struct frame *twoq_select(void);
+static void twoq_add(struct frame *);
+static void twoq_evicted(struct frame *);
+static struct frame *arc_select(void);
+static void arc_add(struct frame *);
+static void arc_evicted(struct frame *);
+
+static const struct vm_policy policies[] =
+  {
+    {"clock", clock_select, NULL, NULL},
+    {"wsclock", wsclock_select, NULL, NULL},
+    {"aging", aging_select, NULL, NULL},
+    {"2q", twoq_select, twoq_add, twoq_evicted},
+    {"arc", arc_select, arc_add, arc_evicted},
+  };
+
+static const struct vm_policy *policy = &policies[0];
+
+/* Frame queues, indexed by enum vm_queue. */
+static struct queue queues[VM_Q_CNT];
+
+/* Number of user frames, the "c" of 2Q and ARC. */
+static size_t user_frames;
+
+static bool frame_evictable(struct frame *);
+static bool frame_test_accessed(struct frame *);
+static bool frame_is_dirty(struct frame *);
+static void queue_push(enum vm_queue, struct frame *);
+static void ghost_push(enum vm_queue, struct page *);
+static void ghost_remove(struct page *);
+static void ghost_trim(enum vm_queue, size_t max);
+
+/* Selects the replacement policy called NAME.  Returns false if
+   there is no such policy. */
+bool
+vm_set_policy(const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp(name, policies[i].name))
     {
-      if (*pde & PTE_P)
-      {
-        uint32_t *pt = pde_get_pt(*pde);
-        uint32_t *pte;
-        
-        for (pte = pt ; pte < pt + PGSIZE / sizeof *pte; pte++)
-        {
-          if (*pte & PTE_P)
-          {
-            if (*pte & PTE_A)
-            {
-              *pte &= ~(uint32_t) PTE_A;
-            }
-            else
-            {
-              return (void *)(((pde - pd) << 22) + ((pte - pt) << 12));
-            }
-          }
-        }
-      }
-    }  
-  }
-  
-  if (turn == 0)
-  {
-    turn++;
-    goto SEARCH_VICTIM;
-  }
-    
+      policy = &policies[i];
+      return true;
+    }
+  return false;
+}
+
+/* Initializes the replacement queues.  Call from frame_init(),
+   after palloc_init(). */
+void
+vm_init(void)
+{
+  int i;
+
+  for (i = 0; i < VM_Q_CNT; i++)
+  {
+    list_init(&queues[i].list);
+    queues[i].cnt = 0;
+  }
+  user_frames = palloc_free_cnt(PAL_USER);
+  printf("Page replacement: %s\n", policy->name);
+}
+
+/* Chooses a frame to evict.  Frames of processes with more
+   pages resident than their working set target go first; after
+   that the current policy decides.  Free, kernel and pinned
+   frames are passed over.  Returns NULL if no frame can be
+   evicted. */
+struct frame *
+select_victim_page(void)
+{
+  struct frame *f = NULL;
+
+  if (page_over_target_cnt > 0)
+    f = select_victim_local(NULL);
+  return f != NULL ? f : policy->select();
+}
+
+/* Hand of the clock used by select_victim_local(). */
+static size_t local_hand;
+
+/* Second-chance scan for a frame held only by a page of process
+   OWNER, or, if OWNER is a null pointer, by a page of any
+   process above its working set target.  Returns NULL if there
+   is none. */
+struct frame *
+select_victim_local(struct thread *owner)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++)
+  {
+    struct frame *f = &frame_table[local_hand];
+    struct thread *t;
+
+    if (++local_hand >= frame_cnt)
+      local_hand = 0;
+
+    if (!frame_evictable(f) || f->page->frame_next != NULL)
+      continue;
+    t = f->page->owner;
+    if (owner != NULL ? t != owner : t->rss <= t->rss_target)
+      continue;
+    if (!frame_test_accessed(f))
+      return f;
+  }
+  return NULL;
+}
+
+/* Called when frame F has been allocated to hold a page. */
+void
+vm_frame_added(struct frame *f)
+{
+  f->queue = VM_Q_NONE;
+  f->age = 0;
+  f->last_use = timer_ticks();
+  if (policy->add != NULL)
+    policy->add(f);
+}
+
+/* Called when the pages in frame F have been evicted, before F
+   is freed. */
+void
+vm_frame_evicted(struct frame *f)
+{
+  if (policy->evicted != NULL)
+    policy->evicted(f);
+}
+
+/* Called when frame F is freed. */
+void
+vm_frame_removed(struct frame *f)
+{
+  if (f->queue != VM_Q_NONE)
+  {
+    list_remove(&f->elem);
+    queues[f->queue].cnt--;
+    f->queue = VM_Q_NONE;
+  }
+}
+
+/* Called when page P is destroyed, to forget it if it was
+   recently evicted. */
+void
+vm_page_removed(struct page *p)
+{
+  ghost_remove(p);
+}
+
+/* Clock hand: index of the next frame to examine.  It persists
+   between evictions so that every frame gets the same second
+   chance, whichever process happens to be faulting. */
+static size_t clock_hand;
+
+/* Second-chance (clock) replacement over the frame table.
+   Frames whose page was accessed since the hand last passed have
+   their accessed bit cleared and are skipped; the first frame
+   found unaccessed is the victim. */
+static struct frame *
+clock_select(void)
+{
+  size_t i;
+
+  /* Two sweeps: the first may only clear accessed bits. */
+  for (i = 0 ; i < 2 * frame_cnt ; i++)
+  {
+    struct frame *f = &frame_table[clock_hand];
+
+    if (++clock_hand >= frame_cnt)
+      clock_hand = 0;
+
+    if (frame_evictable(f) && !frame_test_accessed(f))
+      return f;
+  }
+
+  return NULL;
+}
+
+/* Frames not used for this many ticks are outside the working
+   set. */
+#define WS_TAU TIMER_FREQ
+
+/* WSClock: the clock hand records when each frame was last seen
+   accessed.  The victim is the first frame outside the working
+   set that is clean, so that it can be dropped without a write;
+   failing that, the first one outside the working set, and
+   failing that, the least recently used frame seen. */
+static struct frame *
+wsclock_select(void)
+{
+  int64_t now = timer_ticks();
+  struct frame *old_dirty = NULL, *oldest = NULL;
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+  {
+    struct frame *f = &frame_table[clock_hand];
+
+    if (++clock_hand >= frame_cnt)
+      clock_hand = 0;
+
+    if (!frame_evictable(f))
+      continue;
+    if (frame_test_accessed(f))
+    {
+      f->last_use = now;
+      continue;
+    }
+    if (now - f->last_use > WS_TAU)
+    {
+      if (!frame_is_dirty(f))
+        return f;
+      if (old_dirty == NULL)
+        old_dirty = f;
+    }
+    if (oldest == NULL || f->last_use < oldest->last_use)
+      oldest = f;
+  }
+
+  return old_dirty != NULL ? old_dirty : oldest;
+}
+
+/* Tick of the last aging shift. */
+static int64_t aging_tick = -1;
+
+/* Aging: each frame has an 8-bit history of its accessed bit,
+   shifted right once per timer tick in which an eviction
+   happens.  The frame with the smallest history, that is, the
+   least recently used one at tick granularity, is the victim. */
+static struct frame *
+aging_select(void)
+{
+  int64_t now = timer_ticks();
+  bool shift = now != aging_tick;
+  struct frame *victim = NULL;
+  size_t i;
+
+  aging_tick = now;
+  for (i = 0; i < frame_cnt; i++)
+  {
+    struct frame *f = &frame_table[i];
+
+    if (!frame_evictable(f))
+      continue;
+    if (shift)
+      f->age >>= 1;
+    if (frame_test_accessed(f))
+      f->age |= 0x80;
+    if (victim == NULL || f->age < victim->age)
+      victim = f;
+  }
+
+  return victim;
+}
+
+/* Evicts from the front of Q, giving frames whose accessed bit
+   is set a second chance at the back of MOVE_TO.  Returns NULL
+   if all of Q's frames are pinned or were accessed. */
+static struct frame *
+queue_scan(enum vm_queue q, enum vm_queue move_to)
+{
+  size_t n = queues[q].cnt;
+
+  while (n-- > 0)
+  {
+    struct frame *f = list_entry(list_front(&queues[q].list),
+                                 struct frame, elem);
+
+    if (frame_evictable(f) && !frame_test_accessed(f))
+      return f;
+    vm_frame_removed(f);
+    queue_push(move_to, f);
+  }
   return NULL;
 }
+
+/* 2Q: newly loaded frames enter a FIFO, A1in, that holds a
+   quarter of memory; accesses there are taken as correlated and
+   ignored.  Pages evicted from A1in are remembered in A1out; if
+   one is loaded again it goes to the main queue, Am, which is
+   run as a clock. */
+static struct frame *
+twoq_select(void)
+{
+  struct frame *f = NULL;
+
+  if (queues[VM_Q_A1IN].cnt > user_frames / 4 || queues[VM_Q_AM].cnt == 0)
+  {
+    struct list_elem *e;
+
+    for (e = list_begin(&queues[VM_Q_A1IN].list);
+         e != list_end(&queues[VM_Q_A1IN].list); e = list_next(e))
+    {
+      f = list_entry(e, struct frame, elem);
+      if (frame_evictable(f))
+        return f;
+    }
+  }
+  f = queue_scan(VM_Q_AM, VM_Q_AM);
+  return f != NULL ? f : clock_select();
+}
+
+static void
+twoq_add(struct frame *f)
+{
+  struct page *p = f->page;
+
+  if (p->ghost == VM_Q_A1OUT)
+  {
+    ghost_remove(p);
+    queue_push(VM_Q_AM, f);
+  }
+  else
+    queue_push(VM_Q_A1IN, f);
+}
+
+static void
+twoq_evicted(struct frame *f)
+{
+  if (f->queue == VM_Q_A1IN)
+  {
+    ghost_push(VM_Q_A1OUT, f->page);
+    ghost_trim(VM_Q_A1OUT, user_frames / 2);
+  }
+}
+
+/* Target size of T1 for ARC. */
+static size_t arc_p;
+
+/* ARC, in its clock form (CAR): T1 holds frames seen once
+   recently and T2 frames seen at least twice, each run as a
+   clock, with the accessed bit standing in for a hit.  An
+   accessed frame in T1 moves to T2.  B1 and B2 remember pages
+   evicted from T1 and T2; a fault on one of them moves the
+   target size of T1, arc_p, towards the list it came from. */
+static struct frame *
+arc_select(void)
+{
+  size_t n = 2 * (queues[VM_Q_T1].cnt + queues[VM_Q_T2].cnt) + 1;
+
+  while (n-- > 0)
+  {
+    enum vm_queue q;
+    struct frame *f;
+
+    if (queues[VM_Q_T1].cnt > 0
+        && (queues[VM_Q_T1].cnt >= (arc_p > 0 ? arc_p : 1)
+            || queues[VM_Q_T2].cnt == 0))
+      q = VM_Q_T1;
+    else if (queues[VM_Q_T2].cnt > 0)
+      q = VM_Q_T2;
+    else
+      break;
+
+    f = list_entry(list_front(&queues[q].list), struct frame, elem);
+    if (frame_evictable(f) && !frame_test_accessed(f))
+      return f;
+    vm_frame_removed(f);
+    queue_push(frame_evictable(f) ? VM_Q_T2 : q, f);
+  }
+  return clock_select();
+}
+
+static void
+arc_add(struct frame *f)
+{
+  struct page *p = f->page;
+  size_t b1 = queues[VM_Q_B1].cnt, b2 = queues[VM_Q_B2].cnt;
+
+  if (p->ghost == VM_Q_B1)
+  {
+    size_t delta = b2 > b1 ? b2 / b1 : 1;
+    arc_p = arc_p + delta < user_frames ? arc_p + delta : user_frames;
+    ghost_remove(p);
+    queue_push(VM_Q_T2, f);
+  }
+  else if (p->ghost == VM_Q_B2)
+  {
+    size_t delta = b1 > b2 ? b1 / b2 : 1;
+    arc_p = arc_p > delta ? arc_p - delta : 0;
+    ghost_remove(p);
+    queue_push(VM_Q_T2, f);
+  }
+  else
+  {
+    /* Keep the history no larger than memory. */
+    if (queues[VM_Q_T1].cnt + b1 >= user_frames)
+      ghost_trim(VM_Q_B1, b1 > 0 ? b1 - 1 : 0);
+    else if (queues[VM_Q_T1].cnt + queues[VM_Q_T2].cnt + b1 + b2
+             >= 2 * user_frames)
+      ghost_trim(VM_Q_B2, b2 > 0 ? b2 - 1 : 0);
+    queue_push(VM_Q_T1, f);
+  }
+}
+
+static void
+arc_evicted(struct frame *f)
+{
+  if (f->queue == VM_Q_T1)
+    ghost_push(VM_Q_B1, f->page);
+  else if (f->queue == VM_Q_T2)
+    ghost_push(VM_Q_B2, f->page);
+}
+
+/* Returns true if frame F holds pages and may be evicted. */
+static bool
+frame_evictable(struct frame *f)
+{
+  return f->page != NULL && f->pin_cnt == 0;
+}
+
+/* Returns true if any page sharing frame F was accessed since
+   the last call, and clears their accessed bits. */
+static bool
+frame_test_accessed(struct frame *f)
+{
+  struct page *p;
+  bool accessed = false;
+
+  for (p = f->page; p != NULL; p = p->frame_next)
+    if (pagedir_is_accessed(p->owner->pagedir, p->upage))
+    {
+      pagedir_set_accessed(p->owner->pagedir, p->upage, false);
+      accessed = true;
+    }
+  return accessed;
+}
+
+/* Returns true if any page sharing frame F is dirty. */
+static bool
+frame_is_dirty(struct frame *f)
+{
+  struct page *p;
+
+  for (p = f->page; p != NULL; p = p->frame_next)
+    if (pagedir_is_dirty(p->owner->pagedir, p->upage))
+      return true;
+  return false;
+}
+
+/* Appends frame F to queue Q. */
+static void
+queue_push(enum vm_queue q, struct frame *f)
+{
+  list_push_back(&queues[q].list, &f->elem);
+  queues[q].cnt++;
+  f->queue = q;
+}
+
+/* Appends evicted page P to ghost queue Q. */
+static void
+ghost_push(enum vm_queue q, struct page *p)
+{
+  ghost_remove(p);
+  list_push_back(&queues[q].list, &p->ghost_elem);
+  queues[q].cnt++;
+  p->ghost = q;
+}
+
+/* Forgets page P if it is in a ghost queue. */
+static void
+ghost_remove(struct page *p)
+{
+  if (p->ghost != VM_Q_NONE)
+  {
+    list_remove(&p->ghost_elem);
+    queues[p->ghost].cnt--;
+    p->ghost = VM_Q_NONE;
+  }
+}
+
+/* Drops the oldest pages from ghost queue Q until it holds at
+   most MAX. */
+static void
+ghost_trim(enum vm_queue q, size_t max)
+{
+  while (queues[q].cnt > max)
+    ghost_remove(list_entry(list_front(&queues[q].list),
+                            struct page, ghost_elem));
+}
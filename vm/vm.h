@@ -1,7 +1,31 @@
 #ifndef VM_VM_H
 #define VM_VM_H
-#endif
-#include <stdio.h>
-#include "threads/thread.h"
 
-void *select_victim_page(struct thread **t);
+#include <stdbool.h>
+#include "vm/frame.h"
+
+/* Queues used by the replacement policies.  Frames are kept in
+   the A1IN, AM, T1 and T2 queues, evicted pages in the others. */
+enum vm_queue
+  {
+    VM_Q_NONE,                  /* Not in a queue. */
+    VM_Q_A1IN,                  /* 2Q: loaded once, FIFO. */
+    VM_Q_AM,                    /* 2Q: main clock. */
+    VM_Q_A1OUT,                 /* 2Q: evicted from A1IN. */
+    VM_Q_T1,                    /* ARC: seen once. */
+    VM_Q_T2,                    /* ARC: seen twice or more. */
+    VM_Q_B1,                    /* ARC: evicted from T1. */
+    VM_Q_B2,                    /* ARC: evicted from T2. */
+    VM_Q_CNT
+  };
+
+bool vm_set_policy(const char *name);
+void vm_init(void);
+struct frame *select_victim_page(void);
+struct frame *select_victim_local(struct thread *owner);
+void vm_frame_added(struct frame *);
+void vm_frame_evicted(struct frame *);
+void vm_frame_removed(struct frame *);
+void vm_page_removed(struct page *);
+
+#endif
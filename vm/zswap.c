@@ -0,0 +1,201 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/lz.h"
+
+/* Compressed swap cache.
+
+   Sits in front of the swap disk: a page written to a swap slot
+   is compressed into a pool of kernel memory instead, if it
+   compresses to at most MAX_ZLEN bytes.  The slot stays reserved
+   on disk, so when the pool fills up the least recently used
+   entries are decompressed and written to their slots to make
+   room.  Pages that do not compress go straight to disk. */
+
+#define POOL_DIV 16                     /* Pool is 1/POOL_DIV of RAM. */
+#define CHUNK_SIZE 64                   /* Pool allocation unit. */
+#define MAX_ZLEN (PGSIZE * 3 / 4)       /* Largest page kept. */
+
+/* A compressed page in the pool. */
+struct zswap_entry
+  {
+    struct list_elem lru_elem;          /* Element in lru. */
+    size_t slot;                        /* Swap slot it stands for. */
+    size_t chunk;                       /* First pool chunk. */
+    size_t len;                         /* Compressed size in bytes. */
+  };
+
+static struct lock zswap_lock;
+static uint8_t *pool;                   /* Null if the cache is off. */
+static struct bitmap *chunk_map;        /* true: chunk is in use. */
+static struct zswap_entry **entries;    /* Entry for each slot, if any. */
+static struct list lru;                 /* Least recently used first. */
+static uint8_t *zbuf;                   /* Compression output. */
+static uint8_t *wbuf;                   /* Decompressed page for writeback. */
+static zswap_writeback_func *writeback;
+
+/* Statistics. */
+static unsigned stores, rejects, writebacks, hits, misses;
+static unsigned long long bytes_in, bytes_out;
+
+static void free_entry (struct zswap_entry *);
+static void evict_lru (void);
+
+/* Sets up the cache for SLOT_CNT swap slots, with WRITEBACK to
+   move pages to disk.  Leaves the cache off if memory is short. */
+void
+zswap_init (size_t slot_cnt, zswap_writeback_func *writeback_)
+{
+  size_t pool_pages = ram_pages / POOL_DIV;
+
+  lock_init (&zswap_lock);
+  list_init (&lru);
+  writeback = writeback_;
+  if (slot_cnt == 0 || pool_pages == 0)
+    return;
+
+  pool = palloc_get_multiple (0, pool_pages);
+  chunk_map = bitmap_create (pool_pages * PGSIZE / CHUNK_SIZE);
+  entries = calloc (slot_cnt, sizeof *entries);
+  zbuf = palloc_get_page (0);
+  wbuf = palloc_get_page (0);
+  if (pool == NULL || chunk_map == NULL || entries == NULL
+      || zbuf == NULL || wbuf == NULL)
+    PANIC ("zswap_init: out of memory");
+  printf ("Compressed swap cache: %zu pages\n", pool_pages);
+}
+
+/* Stores KPAGE as the contents of SLOT, compressed, making room
+   by writing back older entries if necessary.  Returns true if
+   successful, false if the page must be written to disk.  Older
+   contents of SLOT are dropped from the cache either way. */
+bool
+zswap_store (size_t slot, const void *kpage)
+{
+  struct zswap_entry *e;
+  size_t len, chunk;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  if (entries[slot] != NULL)
+    free_entry (entries[slot]);
+
+  len = lz_compress (kpage, PGSIZE, zbuf, MAX_ZLEN);
+  e = len != 0 ? malloc (sizeof *e) : NULL;
+  if (e == NULL)
+    {
+      rejects++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+  while ((chunk = bitmap_scan_and_flip (chunk_map, 0,
+                                        DIV_ROUND_UP (len, CHUNK_SIZE),
+                                        false)) == BITMAP_ERROR)
+    evict_lru ();
+
+  memcpy (pool + chunk * CHUNK_SIZE, zbuf, len);
+  e->slot = slot;
+  e->chunk = chunk;
+  e->len = len;
+  entries[slot] = e;
+  list_push_back (&lru, &e->lru_elem);
+  stores++;
+  bytes_in += PGSIZE;
+  bytes_out += len;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Reads the contents of SLOT into KPAGE if the cache has them.
+   Returns true if so, false if they must be read from disk.
+   The entry stays, as does the slot. */
+bool
+zswap_load (size_t slot, void *kpage)
+{
+  struct zswap_entry *e;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  e = entries[slot];
+  if (e == NULL)
+    misses++;
+  else
+    {
+      if (!lz_decompress (pool + e->chunk * CHUNK_SIZE, e->len, kpage, PGSIZE))
+        PANIC ("zswap: slot %zu is corrupt", slot);
+      list_remove (&e->lru_elem);
+      list_push_back (&lru, &e->lru_elem);
+      hits++;
+    }
+  lock_release (&zswap_lock);
+  return e != NULL;
+}
+
+/* Drops the cached contents of SLOT, if any, once the slot is
+   freed. */
+void
+zswap_invalidate (size_t slot)
+{
+  if (pool == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  if (entries[slot] != NULL)
+    free_entry (entries[slot]);
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap cache statistics. */
+void
+zswap_print_stats (void)
+{
+  printf ("zswap : %u stored, %u incompressible, %u written back\n",
+          stores, rejects, writebacks);
+  printf ("zswap : %u hits, %u misses, %u disk writes avoided\n",
+          hits, misses, stores - writebacks);
+  if (bytes_in > 0)
+    printf ("zswap : compressed to %u%%\n",
+            (unsigned) (bytes_out * 100 / bytes_in));
+}
+
+/* Releases E and its pool chunks. */
+static void
+free_entry (struct zswap_entry *e)
+{
+  bitmap_set_multiple (chunk_map, e->chunk, DIV_ROUND_UP (e->len, CHUNK_SIZE),
+                       false);
+  list_remove (&e->lru_elem);
+  entries[e->slot] = NULL;
+  free (e);
+}
+
+/* Writes the least recently used entry back to its slot on disk
+   and frees it.  The pool cannot be empty, since any compressed
+   page fits in an empty pool. */
+static void
+evict_lru (void)
+{
+  struct zswap_entry *e;
+
+  ASSERT (!list_empty (&lru));
+  e = list_entry (list_front (&lru), struct zswap_entry, lru_elem);
+  if (!lz_decompress (pool + e->chunk * CHUNK_SIZE, e->len, wbuf, PGSIZE))
+    PANIC ("zswap: slot %zu is corrupt", e->slot);
+  writeback (e->slot, wbuf);
+  free_entry (e);
+  writebacks++;
+}
@@ -0,0 +1,16 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Writes the uncompressed PAGE to swap slot SLOT on disk. */
+typedef void zswap_writeback_func (size_t slot, const void *page);
+
+void zswap_init (size_t slot_cnt, zswap_writeback_func *);
+bool zswap_store (size_t slot, const void *kpage);
+bool zswap_load (size_t slot, void *kpage);
+void zswap_invalidate (size_t slot);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */